@@ -8,6 +8,7 @@
 #include <limits.h>
 
 #include "bst.h"
+#include "mem.h"
 
 #define MYMAX(a, b) (a > b ? a : b)
 //counters for statistics
@@ -26,7 +27,7 @@ int rec_height(bst_node_t *N);
 int children(bst_node_t *N);
 void pretty_print(bst_t *T);
 
-bst_node_t *newNode(int key, data_t elem_ptr);
+bst_node_t *newNode(bst_t *T, int key, data_t elem_ptr);
 
 /* searchViaNode helper function that finds the element with the matching key given
  * the root and returns the node in which it exists.
@@ -84,7 +85,24 @@ data_t bst_access(bst_t *T, bst_key_t key)
  */
 bst_t *bst_construct(int tree_policy)
 {
+    return bst_construct_slab(tree_policy, NULL);
+}
+
+/* Same as bst_construct, but the tree nodes are allocated from slab, which
+ * must hand out slots of at least sizeof(bst_node_t) bytes.  The slab may
+ * be shared by several trees and is not destroyed with the tree.  A NULL
+ * slab means malloc.
+ *
+ * tree_policy - tree management policy to use either AVL or BST.
+ * slab - slab to take nodes from, or NULL
+ *
+ * RETURNS pointer to the newly created tree
+ */
+bst_t *bst_construct_slab(int tree_policy, struct mem_slab_tag *slab)
+{
+    assert(slab == NULL || slab->slot_bytes >= (int) sizeof(bst_node_t));
     bst_t *newTree = (bst_t *)malloc(sizeof(bst_t));   
+    newTree->node_slab = slab;
     newTree->root = NULL;
     newTree->size = 0;
     newTree->num_recent_rotations = 0;
@@ -95,19 +113,23 @@ bst_t *bst_construct(int tree_policy)
 
 /* bst_destruct helper function that recurses through tree freeing as it goes
  *
+ * T - tree the nodes belong to
  * node -  root node of tree to be destructed
  */
-void deleteTree(bst_node_t *node) {
+void deleteTree(bst_t *T, bst_node_t *node) {
     if (node == NULL) return;
  
     //delete both subtrees
-    deleteTree(node->left);
-    deleteTree(node->right);
+    deleteTree(T, node->left);
+    deleteTree(T, node->right);
     free(node->data_ptr);
    
     //then delete node
     //printf("\n Deleting node: %d", node->key);
-    free(node);
+    if (T->node_slab != NULL)
+        Mem_slab_free(T->node_slab, node);
+    else
+        free(node);
 }
 
 /* Free all items stored in the tree including the memory block with the data
@@ -117,20 +139,26 @@ void deleteTree(bst_node_t *node) {
  */
 void bst_destruct(bst_t *T)
 {
-    deleteTree(T->root);
+    deleteTree(T, T->root);
     free(T);
 }
 
 /* Creates/mallocs a new node that can be inserted to a binary tree,
- * initilzes the data, key and height.
+ * initilzes the data, key and height.  The node comes from the tree's
+ * slab if it has one.
  *
+ * T - tree the node is for
  * key - key to be assigned to new node
  * elem_ptr - data to be assigned to new node
  *
  * RETURNS a pointer to the new node
  */
-bst_node_t *newNode(int key, data_t elem_ptr) {
-    bst_node_t *temp = (bst_node_t *)malloc(sizeof(bst_node_t));
+bst_node_t *newNode(bst_t *T, int key, data_t elem_ptr) {
+    bst_node_t *temp;
+    if (T->node_slab != NULL)
+        temp = (bst_node_t *)Mem_slab_alloc(T->node_slab);
+    else
+        temp = (bst_node_t *)malloc(sizeof(bst_node_t));
     temp->data_ptr = elem_ptr;
     temp->key = key;
     temp->height = 1;
@@ -162,7 +190,7 @@ int bst_insert(bst_t *T, bst_key_t key, data_t elem_ptr)
     bst_node_t *parent = NULL;
     
     if (T->root == NULL) {
-        T->root = newNode(key, elem_ptr);
+        T->root = newNode(T, key, elem_ptr);
         return 1;
     }
     
@@ -185,9 +213,9 @@ int bst_insert(bst_t *T, bst_key_t key, data_t elem_ptr)
     
     //create new node and assign to parent pointer
     if (key < parent->key)
-        parent->left = newNode(key, elem_ptr);
+        parent->left = newNode(T, key, elem_ptr);
     else
-        parent->right = newNode(key, elem_ptr);
+        parent->right = newNode(T, key, elem_ptr);
         
     return 1;
 }
@@ -278,7 +306,7 @@ int getBalance(bst_node_t *node) {
  */
 bst_node_t *avlInsert(bst_t *T, bst_node_t *node, bst_key_t key, data_t elem_ptr) {
     if (node == NULL)
-        return newNode(key, elem_ptr);
+        return newNode(T, key, elem_ptr);
     CompCalls++;
     if (key < node->key)
         node->left = avlInsert(T, node->left, key, elem_ptr);
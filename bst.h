@@ -24,12 +24,14 @@ typedef struct bst_tag {
     int num_recent_rotations;       // number of rotations in last operation
     int policy;			    // must be BST or AVL
     int num_recent_key_comparisons; // number of comparisons in last operation
+    struct mem_slab_tag *node_slab; // nodes come from this slab, or malloc if NULL
 } bst_t;
 
 
 /* prototype definitions for functions in bst.c */
 data_t bst_access(bst_t *bst_ptr, bst_key_t key);
 bst_t *bst_construct(int);
+bst_t *bst_construct_slab(int, struct mem_slab_tag *slab);
 void bst_destruct(bst_t *bst_ptr);
 int bst_insert(bst_t *bst_ptr, bst_key_t key, data_t elem_ptr);
 int bst_avl_insert(bst_t *bst_ptr, bst_key_t key, data_t elem_ptr);
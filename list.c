@@ -8,6 +8,7 @@
 
 #include "datatypes.h"   /* defines data_t */
 #include "list.h"        /* defines public functions for list ADT */
+#include "mem.h"         /* defines the slab allocator for list nodes */
 
 /* definitions for private constants used in list.c only */
 #define LIST_SORTED_ASCENDING   -1234567
@@ -21,6 +22,35 @@ void list_insertion_sort(list_t** L, int sort_order);
 void list_recursive_selection_sort(list_t** L, int sort_order);
 void list_selection_sort(list_t** L, int sort_order);
 void list_merge_sort(list_t** L, int sort_order);
+list_node_t *allocNode(list_t *L);
+void freeNode(list_t *L, list_node_t *N);
+
+/* Allocates a node for list L from its slab, or with malloc if the list
+ * was not given a slab.
+ *
+ * L: pointer to list-of-interest
+ *
+ * returns: pointer to the uninitialized node
+ */
+list_node_t *allocNode(list_t *L)
+{
+    if (L->node_slab != NULL)
+        return (list_node_t *) Mem_slab_alloc(L->node_slab);
+    return (list_node_t *) malloc(sizeof(list_node_t));
+}
+
+/* Returns node N to wherever allocNode got it from.
+ *
+ * L: pointer to list-of-interest
+ * N: pointer to the node to free
+ */
+void freeNode(list_t *L, list_node_t *N)
+{
+    if (L->node_slab != NULL)
+        Mem_slab_free(L->node_slab, N);
+    else
+        free(N);
+}
 
 /* Find the max node of a given list.
  * 
@@ -119,7 +149,8 @@ void list_insertion_sort(list_t** L, int sort_order)
     int iterator;
     if (L != NULL) {
         //create new sorted list
-        list_t* newList = list_construct((*L)->comp_proc, (*L)->data_clean);
+        list_t* newList = list_construct_slab((*L)->comp_proc, (*L)->data_clean,
+                (*L)->node_slab);
         (newList)->list_sorted_state = sort_order == 1 ? LIST_SORTED_ASCENDING
             : LIST_SORTED_DESCENDING;
             
@@ -237,7 +268,8 @@ void split(list_t *list_ptr1, list_t *list_ptr2)
 list_t *listMerge(list_t *list_ptr1, list_t *list_ptr2, int sort_order)
 {
     int testerProc;
-    list_t *list3 = list_construct(list_ptr1->comp_proc, list_ptr1->data_clean);
+    list_t *list3 = list_construct_slab(list_ptr1->comp_proc, list_ptr1->data_clean,
+            list_ptr1->node_slab);
 
     while ((list_ptr1->current_list_size > 0) && (list_ptr2->current_list_size > 0)) {
         data_t *list1Head = list_access(list_ptr1, LISTPOS_HEAD);
@@ -279,7 +311,7 @@ void list_merge_sort(list_t** L, int sort_order)
     if ((*L)->current_list_size > 1) {
         //malloc the pointer to the pointer
         list_t *list;
-        list = list_construct((*L)->comp_proc, (*L)->data_clean);
+        list = list_construct_slab((*L)->comp_proc, (*L)->data_clean, (*L)->node_slab);
 
         //call split function that splits list into two
         split(*L, list);
@@ -362,8 +394,20 @@ data_t * list_access(list_t *list_ptr, int pos_index)
  */
 list_t * list_construct(int (*fcomp)(const data_t *, const data_t *),
         void (*dataclean)(data_t *))
+{
+    return list_construct_slab(fcomp, dataclean, NULL);
+}
+
+/* Same as list_construct, but the list nodes are allocated from slab,
+ * which must hand out slots of at least sizeof(list_node_t) bytes.  The
+ * slab may be shared by many lists and is not destroyed with the list.
+ * A NULL slab means malloc.
+ */
+list_t * list_construct_slab(int (*fcomp)(const data_t *, const data_t *),
+        void (*dataclean)(data_t *), struct mem_slab_tag *slab)
 {
     list_t *L;
+    assert(slab == NULL || slab->slot_bytes >= (int) sizeof(list_node_t));
     L = (list_t *) malloc(sizeof(list_t));
     L->head = NULL;
     L->tail = NULL;
@@ -371,6 +415,7 @@ list_t * list_construct(int (*fcomp)(const data_t *, const data_t *),
     L->list_sorted_state = LIST_SORTED_ASCENDING;
     L->comp_proc = fcomp;
     L->data_clean = dataclean;
+    L->node_slab = slab;
 
     /* the last line of this function must call validate */
     list_debug_validate(L);
@@ -435,11 +480,10 @@ void list_destruct(list_t *list_ptr)
     while (current != NULL) {             
         list_ptr->data_clean(current->data_ptr);        
         list_node_t* temp = current->next;
-        free(current);
+        freeNode(list_ptr, current);
         current = temp;
     }
 
-    free(current);
     free(list_ptr);
 }
 
@@ -471,7 +515,7 @@ void list_insert(list_t *list_ptr, data_t *elem_ptr, int pos_index)
     assert(list_ptr != NULL);
     int i;
     
-    list_node_t *newNode = (list_node_t *)malloc(sizeof(list_node_t));
+    list_node_t *newNode = allocNode(list_ptr);
     newNode->data_ptr = elem_ptr;
     newNode->prev = NULL;
     newNode->next = NULL;
@@ -548,8 +592,8 @@ void list_insert_sorted(list_t *list_ptr, data_t *elem_ptr)
     assert(list_ptr != NULL);
     assert(list_ptr->list_sorted_state != LIST_UNSORTED);
     
-    //malloc new node
-    list_node_t *newNode = (list_node_t *)malloc(sizeof(list_node_t));
+    //allocate new node
+    list_node_t *newNode = allocNode(list_ptr);
     newNode->data_ptr = elem_ptr;
     newNode->next = NULL;
     newNode->prev = NULL;
@@ -625,6 +669,7 @@ data_t * list_remove(list_t *list_ptr, int pos_index)
     
     int i;
     list_node_t *current, *current2;
+    data_t *removed;
     current = list_ptr->head;
     
     for (i = 0; i < pos_index; i++) {
@@ -634,42 +679,35 @@ data_t * list_remove(list_t *list_ptr, int pos_index)
     
     //if only one element
     if (list_ptr->current_list_size == 1) {
-        current->prev = NULL;
-        current->next = NULL;
         list_ptr->head = NULL;
         list_ptr->tail = NULL;
-        list_ptr->current_list_size--;
-        list_debug_validate(list_ptr);
-        return current2->data_ptr;
     }
     //is head
-    if (pos_index == 0) {
+    else if (pos_index == 0) {
         current = current->next;
         current->prev = NULL;
         list_ptr->head = current;
-        list_ptr->current_list_size--;
-        list_debug_validate(list_ptr);
-        return current2->data_ptr;
     }
     //is tail
-    if (pos_index == (list_ptr->current_list_size - 1)) {
+    else if (pos_index == (list_ptr->current_list_size - 1)) {
         current = current->prev;
         current->next = NULL;
         list_ptr->tail = current;
-        list_ptr->current_list_size--;
-        list_debug_validate(list_ptr);
-        return current2->data_ptr;
-    }  
-    
+    }
     //set to node after current
-    current = current->next;
-    current->prev = current2->prev;
-    current2->prev->next = current;
+    else {
+        current = current->next;
+        current->prev = current2->prev;
+        current2->prev->next = current;
+    }
     list_ptr->current_list_size--;
-        
-    /* fix the return value */
+
+    //release the node, keeping the element for the caller
+    removed = current2->data_ptr;
+    freeNode(list_ptr, current2);
+
     list_debug_validate(list_ptr);
-    return current2->data_ptr;
+    return removed;
 }
 
 /* Reverse the order of the elements in the list.  Also change the 
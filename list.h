@@ -22,6 +22,8 @@ typedef struct list_tag {
     // Private method for list.c only
     int (*comp_proc)(const data_t *, const data_t *);
     void (*data_clean)(data_t *);
+    // nodes come from this slab (see mem.h), or from malloc if NULL
+    struct mem_slab_tag *node_slab;
 } list_t;
 
 /* public prototypes defintions for MP3 */
@@ -31,6 +33,8 @@ void list_sort(list_t **list_ptr, int sort_type, int sort_order);
 data_t * list_access(list_t *list_ptr, int pos_index);
 list_t * list_construct(int (*fcomp)(const data_t *, const data_t *),
                         void (*dataclean)(data_t *));
+list_t * list_construct_slab(int (*fcomp)(const data_t *, const data_t *),
+                        void (*dataclean)(data_t *), struct mem_slab_tag *slab);
 data_t * list_elem_find(list_t *list_ptr, data_t *elem_ptr, int *pos_index);
 void     list_destruct(list_t *list_ptr);
 void     list_insert(list_t *list_ptr, data_t *elem_ptr, int pos_index);
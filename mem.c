@@ -1,340 +1,2453 @@
 /* Donald Elmore
  * Purpose: This file investigates strategies for managing a memory heap via
  *  Mem_alloc and Mem_free, without calling malloc or free.
- * Bugs: When user requests exactly one page, behavior is not consistent.
+ *
+ *  Every chunk carries boundary tags: the header records whether the chunk
+ *  is in use and whether the chunk physically before it is free, and each
+ *  free chunk repeats its size in its last unit (the footer).  Free chunks
+ *  are kept on doubly-linked circular lists, so Mem_free can merge a block
+ *  with both of its physical neighbours in constant time.
+ *
+ *  Layout of a free chunk p (units of sizeof(chunk_t)):
+ *      p[0]            header: next link, size, flags
+ *      p[1].next       back link (PREV_LINK)
+ *      p[size-1].size  footer: copy of the size
+ *
+ *  Built with MEM_COMPACT_HEADER the header is only size and flags, eight
+ *  bytes, and both links move into the payload (see LINK below), which
+ *  they only occupy while the chunk is free.
+ *
+ *  Each region obtained from morecore ends with a fencepost that is always
+ *  marked in use, so no chunk ever merges past the region end.
+ *  Pages come from sbrk or, with PageSource == MMAP_SOURCE, from anonymous
+ *  mappings.  Requests of MmapThreshold bytes or more bypass the heap and
+ *  get a mapping of their own that Mem_free unmaps.
+ *
+ *  All of this state lives in a mem_heap_t.  Mem_alloc and Mem_free use a
+ *  default heap; Mem_heap_create makes further heaps that share nothing
+ *  with it but the page source.
+ * Bugs: None known
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <execinfo.h>
+
+#include "mem.h"
+
+// settings declared in mem.h
+int SearchPolicy;
+int Coalescing;
+int PageSource;
+int MmapThreshold;
+int GrowMinPages;
+int GrowMaxPages;
+int DecayMillis;
+int HugePages;
+int Prefault;
+int ProfileBytes;
+int ThreadSafe;
+
+// chunk flags
+#define CHUNK_INUSE     0x1     // chunk is allocated
+#define CHUNK_PREV_FREE 0x2     // the chunk physically before this one is free
+#define CHUNK_FENCE     0x4     // end-of-region fencepost
+#define CHUNK_MMAPPED   0x8     // chunk has a mapping of its own; on a
+                                // fencepost, its region was mapped
+#define CHUNK_PURGED    0x10    // free chunk whose whole pages went back to the OS
+#define CHUNK_SAMPLED   0x20    // in-use chunk tracked by the heap profiler
+
+#ifdef MEM_COMPACT_HEADER
+// Compact headers: a unit is eight bytes, just size and flags, so every
+// link of a free chunk takes a whole unit of its payload:
+//      p[1]            next link
+//      p[2]            back link
+//      p[3], p[4]      size tree links, with the height in p[5].size
+// The smallest free chunk is then the header, two links and the footer.
+#define LINK(p)         (*(chunk_t **) ((p) + 1))
+#define PREV_LINK(p)    (*(chunk_t **) ((p) + 2))
+#define TREE_LEFT(p)    (*(chunk_t **) ((p) + 3))
+#define TREE_RIGHT(p)   (*(chunk_t **) ((p) + 4))
+#define TREE_HEIGHT(p)  (((p) + 5)->size)
+#define MIN_CHUNK       4
+// list sentinels need room for both links, fenceposts for their link
+#define SENTINEL_UNITS  3
+#define FENCE_UNITS     2
+// units at the start of a free chunk that decay must not purge
+#define KEEP_UNITS      6
+// arena and slab blocks chain through the first word of their payload
+#define BLOCK_LINK_BYTES sizeof(chunk_t *)
+#else
+#define LINK(p)         ((p)->next)
+#define PREV_LINK(p)    (((p) + 1)->next)
+#define TREE_LEFT(p)    (((p) + 2)->next)
+#define TREE_RIGHT(p)   (((p) + 3)->next)
+#define TREE_HEIGHT(p)  (((p) + 2)->size)
+// smallest chunk that can be put on a free list: header plus one unit
+// holding the back link and the footer
+#define MIN_CHUNK       2
+#define SENTINEL_UNITS  2
+#define FENCE_UNITS     1
+#define KEEP_UNITS      4
+#define BLOCK_LINK_BYTES 0
+#endif
+
+// boundary tag helpers
+#define FOOTER(p)       ((p) + (p)->size - 1)
+#define NEXT_CHUNK(p)   ((p) + (p)->size)
+// when a free chunk was freed, in ms; the footer has room for it
+#define FREED_AT(p)     (FOOTER(p)->flags)
+#define PREV_CHUNK(p)   ((p) - ((p) - 1)->size)
+// first chunk of the region that fencepost end closes
+#define REGION_START(end) ((end) + FENCE_UNITS - (end)->size)
+// payload of an arena or slab block, after its chain link
+#define BLOCK_DATA(p)   ((char *) ((p) + 1) + BLOCK_LINK_BYTES)
+
+// The thread that holds an in-use chunk reads its flags without the heap
+// lock, while in thread-safe mode the release or split of its physical
+// predecessor sets or clears CHUNK_PREV_FREE in the same word under the
+// lock.  Both sides of that race go through relaxed atomics; without
+// ThreadSafe the update stays a plain read-modify-write.
+#define OWNER_FLAGS(p)  __atomic_load_n(&(p)->flags, __ATOMIC_RELAXED)
+#define MARK_PREV_FREE(p) (ThreadSafe == TRUE \
+        ? (void) __atomic_fetch_or(&(p)->flags, CHUNK_PREV_FREE, __ATOMIC_RELAXED) \
+        : (void) ((p)->flags |= CHUNK_PREV_FREE))
+#define CLEAR_PREV_FREE(p) (ThreadSafe == TRUE \
+        ? (void) __atomic_fetch_and(&(p)->flags, ~CHUNK_PREV_FREE, __ATOMIC_RELAXED) \
+        : (void) ((p)->flags &= ~CHUNK_PREV_FREE))
+
+// units of the chunk for an object of n bytes, header included
+#define REQUEST_UNITS(n) MEM_MAX(((n) + sizeof(chunk_t) - 1) / sizeof(chunk_t) + 1, MIN_CHUNK)
+
+#define MEM_MAX(a, b)   ((a) > (b) ? (a) : (b))
+#define MEM_MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+#define NUM_BINS 64
+
+// size and alignment of a transparent huge page
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+// TLSF: a free chunk of size units, 2^m <= size < 2^(m+1), is filed under
+// first level m - TLSF_SL_LOG2 + 1 and under the second level sl that
+// says which of TLSF_SL_COUNT equal slices of that range it falls in.
+// Sizes below TLSF_SL_COUNT units share first level 0, one list per size.
+#define TLSF_SL_LOG2    4
+#define TLSF_SL_COUNT   (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT   (31 - TLSF_SL_LOG2 + 1)
+
+// the bins followed by the TLSF lists, as walked by mem_list_head
+#define NUM_LISTS       (NUM_BINS + TLSF_FL_COUNT * TLSF_SL_COUNT)
+
+// A heap: its free lists, the regions it got from morecore, its settings
+// and its statistics.  Heaps never share chunks, so one heap's
+// fragmentation does not spread to another.
+struct mem_heap_tag {
+    // The dummy is a SENTINEL_UNITS sentinel so that it has room for its
+    // back link.
+    chunk_t dummy[SENTINEL_UNITS];
+    chunk_t *rover;
+    // Fencepost at the end of the most recent region.  Fenceposts are
+    // chained through their LINK and their size is the length of
+    // the region in units, fencepost included, so the whole heap can be
+    // walked.
+    chunk_t *top;
+    // Segregated fit: bins[i] is a circular list (with a sentinel like
+    // dummy) of free chunks of exactly i units, header included.  Chunks
+    // of NUM_BINS units or more stay in the dummy list.
+    chunk_t bins[NUM_BINS][SENTINEL_UNITS];
+    int bins_ready;
+    // Best fit: free chunks of NUM_BINS units or more are also indexed by
+    // an AVL tree ordered by (size, address), so the best fit is a ceiling
+    // search.  The tree links live in the payload of the free chunk.
+    chunk_t *size_tree;
+    // TLSF: tlsf[fl][sl] is a circular list of free chunks, like a bin.
+    // Bit fl of tlsf_fl is set when any list of first level fl is not
+    // empty, bit sl of tlsf_sl[fl] when tlsf[fl][sl] is not empty, so a
+    // list that fits is found with two bit scans.
+    chunk_t tlsf[TLSF_FL_COUNT][TLSF_SL_COUNT][SENTINEL_UNITS];
+    unsigned int tlsf_fl;
+    unsigned int tlsf_sl[TLSF_FL_COUNT];
+    int search_policy;
+    int active_policy;          // policy the free chunks are currently filed under
+    int coalescing;
+    int num_pages;
+    int grow_pages;             // size of the last geometric growth step
+    int num_sbrk_calls;
+    int num_mmap_calls;         // mmap calls for heap pages and large chunks
+    int num_mappings;           // large-chunk mappings currently live
+    long mmapped_bytes;         // bytes held by those mappings
+    long purged_bytes;          // heap bytes handed back with madvise
+    long huge_bytes;            // heap bytes advised MADV_HUGEPAGE
+    int decay_ticks;            // releases since the decay clock was read
+    unsigned int last_decay;    // ms time of the last decay pass
+    int num_realloc_in_place;   // Mem_realloc calls that kept the chunk
+    int num_realloc_copied;     // Mem_realloc calls that had to copy
+    pthread_mutex_t lock;       // taken when ThreadSafe is TRUE
+    // Remote frees: in thread-safe mode a thread other than the owner does
+    // not take the lock to free into a heap made by Mem_heap_create, but
+    // pushes the chunk on remote_frees with a CAS, linked through LINK.
+    // The owner takes the whole list at once when it next allocates.
+    pthread_t owner;
+    _Atomic(chunk_t *) remote_frees;
+    long num_remote_frees;      // chunks released from remote_frees
+};
+
+// Global variables required in mem.c only
+//
+// The heap behind Mem_alloc and Mem_free.  It takes its settings from
+// SearchPolicy and Coalescing, and its lists are set up by the first
+// mem_lock.
+static mem_heap_t DefaultHeap = {
+    .search_policy = FIRST_FIT,
+    .active_policy = FIRST_FIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// where the active policy of heap H files a free chunk of a given size.
+// Built with MEM_BEST_FIT_SCAN, best fit keeps every free chunk on the
+// dummy list and scans all of it, as it did before the size tree, so the
+// two can be compared.
+#ifdef MEM_BEST_FIT_SCAN
+#define IN_BINS(H, size) ((H)->active_policy == SEGREGATED_FIT && (size) < NUM_BINS)
+#define IN_TREE(H, size) FALSE
+#else
+#define IN_BINS(H, size) (((H)->active_policy == SEGREGATED_FIT \
+                            || (H)->active_policy == BEST_FIT) && (size) < NUM_BINS)
+#define IN_TREE(H, size) ((H)->active_policy == BEST_FIT && (size) >= NUM_BINS)
+#endif
+#define IN_TLSF(H)       ((H)->active_policy == TLSF_FIT)
+
+// Thread-safe mode: every heap is guarded by its lock.  In front of the
+// default heap every thread keeps a cache of recently freed small chunks,
+// Cache[i] holding up to CACHE_MAX chunks of exactly i units.  Cached
+// chunks stay marked in use, so the heap never merges with them.
+#define CACHE_MAX   16
+// releases between two reads of the clock for decay
+#define DECAY_TICKS 1024
+#define CACHE_BATCH 8
+static pthread_once_t CacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t CacheKey;
+static __thread chunk_t *Cache[NUM_BINS];
+static __thread int CacheCount[NUM_BINS];
+static atomic_long CachedBytes = 0;
+// serializes sbrk calls made for different heaps
+static pthread_mutex_t SbrkLock = PTHREAD_MUTEX_INITIALIZER;
+// sbrk regions of destroyed heaps, chained through their fenceposts and
+// guarded by SbrkLock; morecore hands them out before moving the break
+static chunk_t *Retired = NULL;
+
+// Trace mode: while TraceFile is open every Mem_alloc, Mem_alloc_aligned,
+// Mem_free and Mem_realloc on the default heap appends a mem_trace_rec_t
+// to it.
+// Records are buffered and written TRACE_BUFFER at a time.
+#define TRACE_MAGIC     "MEMTRC1"
+#define TRACE_BUFFER    4096
+typedef struct mem_trace_rec_tag {
+    uint64_t ptr;           // address of the object, used as its id
+    uint32_t delta_ns;      // time since the previous record, saturating
+    int32_t size;           // bytes requested, 0 for a free
+} mem_trace_rec_t;
+static FILE *TraceFile = NULL;
+static mem_trace_rec_t TraceBuf[TRACE_BUFFER];
+static int TraceCount = 0;
+static struct timespec TraceLast;
+static pthread_mutex_t TraceLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Profile mode: while ProfileBytes is above 0, Mem_alloc samples about one
+// allocation per ProfileBytes bytes.  A sample adds its call stack to
+// Stacks, where equal stacks share an entry, and its object to Live until
+// Mem_free finds CHUNK_SAMPLED on it.  Both tables are mapped on the first
+// sample, probed linearly, and guarded by the lock of the default heap;
+// samples that find a table three quarters full are dropped.
+#define PROFILE_DEPTH   32
+#define PROFILE_STACKS  4096
+#define PROFILE_LIVE    65536
+typedef struct mem_stack_tag {
+    uint64_t hash;          // 0 for an empty entry
+    int depth;
+    void *frames[PROFILE_DEPTH];
+    long inuse_objs;        // samples still live
+    long inuse_bytes;
+    long alloc_objs;        // every sample
+    long alloc_bytes;
+} mem_stack_t;
+typedef struct mem_sample_tag {
+    uintptr_t ptr;          // 0 for an empty entry
+    int stack;              // index in Stacks
+    int size;               // bytes requested
+} mem_sample_t;
+static mem_stack_t *Stacks = NULL;
+static mem_sample_t *Live = NULL;
+static int NumStacks = 0;
+static int NumLive = 0;
+static long NumDropped = 0;
+// bytes left before this thread's next sample, and its random state
+static __thread long SampleCountdown;
+static __thread unsigned int SampleSeed;
+
+// default payload of an arena block
+#define ARENA_BLOCK ((int) (4 * PAGESIZE - sizeof(chunk_t) - BLOCK_LINK_BYTES))
+// payload of a slab block, unless the slots are too large to fit SLAB_MIN
+#define SLAB_BLOCK  ((int) (PAGESIZE - sizeof(chunk_t) - BLOCK_LINK_BYTES))
+#define SLAB_MIN    8
+// arena objects are rounded up to whole units so they stay aligned
+#define ARENA_ROUND(n)  (((n) + sizeof(chunk_t) - 1) / sizeof(chunk_t) * sizeof(chunk_t))
+
+// private function prototypes
+void mem_validate(mem_heap_t *H);
+void mem_init(mem_heap_t *H);
+void mem_link(mem_heap_t *H, chunk_t *p);
+void mem_unlink(mem_heap_t *H, chunk_t *p);
+void mem_set_free(chunk_t *p);
+unsigned int mem_now_ms(void);
+long mem_purgeable(chunk_t *p, char **start);
+void mem_decay(mem_heap_t *H, int idleMillis);
+void mem_relink_all(mem_heap_t *H);
+int mem_tree_cmp(chunk_t *a, chunk_t *b);
+int mem_tree_height(chunk_t *node);
+chunk_t *mem_tree_rotate_right(chunk_t *y);
+chunk_t *mem_tree_rotate_left(chunk_t *x);
+chunk_t *mem_tree_balance(chunk_t *node);
+chunk_t *mem_tree_insert(chunk_t *node, chunk_t *p);
+chunk_t *mem_tree_remove(chunk_t *node, chunk_t *p);
+chunk_t *mem_tree_ceiling(mem_heap_t *H, int units);
+void mem_tlsf_index(int size, int *fl, int *sl);
+chunk_t *mem_list_head(mem_heap_t *H, int i);
+chunk_t *mem_tlsf_find(mem_heap_t *H, int units);
+int mem_tree_check(mem_heap_t *H, chunk_t *node, int *count);
+chunk_t *mem_find(mem_heap_t *H, int units);
+chunk_t *mem_take(mem_heap_t *H, chunk_t *p, int units);
+chunk_t *mem_release(mem_heap_t *H, chunk_t *p);
+chunk_t *mem_grow(mem_heap_t *H, int pageCount);
+char *mem_reuse(int new_bytes);
+int mem_huge_pages(int pageCount);
+long mem_advise_huge(char *start, long bytes);
+void mem_prefault(char *start, long bytes);
+chunk_t *mem_alloc_chunk(mem_heap_t *H, int units);
+chunk_t *mem_map_chunk(mem_heap_t *H, int units);
+void mem_trim(mem_heap_t *H, chunk_t *p, int units);
+int mem_resize(mem_heap_t *H, chunk_t *p, int units);
+void mem_unmap_chunk(mem_heap_t *H, chunk_t *p);
+void mem_check_chunk(mem_heap_t *H, chunk_t *p);
+void mem_lock(mem_heap_t *H);
+void mem_unlock(mem_heap_t *H);
+void mem_cache_key(void);
+void mem_cache_exit(void *unused);
+void mem_cache_drain(int bin, int count);
+void mem_remote_push(mem_heap_t *H, chunk_t *p);
+void mem_remote_drain(mem_heap_t *H);
+chunk_t *mem_arena_block(int nbytes);
+int mem_slab_grow(mem_slab_t *S);
+void *mem_cache_alloc(int units);
+void mem_trace(void *ptr, int nbytes);
+long mem_elapsed_ns(struct timespec *from, struct timespec *to);
+int mem_cmp_long(const void *a, const void *b);
+int mem_replay(const char *path, mem_heap_t *H, mem_replay_t *R, int timeAllocs);
+long mem_sample_interval(void);
+void mem_sample(void *ptr, int nbytes);
+void mem_unsample(chunk_t *p);
+void mem_resample(chunk_t *p, int nbytes);
+
+/* morecore
+ * function to request 1 or more pageCount from the operating system for
+ * heap H.
+ *
+ * new_bytes must point to the number of bytes that are being requested
+ *           from the OS with the sbrk command, or with mmap when
+ *           PageSource is MMAP_SOURCE.  It must be an integer multiple of
+ *           the PAGESIZE, and is updated to the number of bytes obtained
+ *
+ * With HugePages the request is rounded up by mem_huge_pages, a mapping
+ * starts on a 2 MB boundary and the aligned 2 MB spans of the new pages
+ * are advised MADV_HUGEPAGE.  With Prefault the
+ * new pages are faulted in before they are returned.
+ *
+ * returns a pointer to the new memory location.  If the request for
+ * new memory fails this function simply returns NULL, and assumes some
+ * calling function will handle the error condition.  Since the error
+ * condition is catastrophic, nothing can be done but to terminate
+ * the program.
+ */
+chunk_t *morecore(mem_heap_t *H, int *new_bytes_p)
+{
+    char *cp, *aligned;
+    chunk_t *new_test1;
+    long slack = 0;
+    int populate = 0;
+    int new_bytes = *new_bytes_p;
+
+    assert(new_bytes % PAGESIZE == 0 && new_bytes > 0);
+    assert(PAGESIZE % sizeof(chunk_t) == 0);
+    if (PageSource == MMAP_SOURCE) {
+        //map a huge page more than needed and trim to a 2 MB boundary
+        if (HugePages == TRUE) {
+            slack = HUGE_PAGE_BYTES;
+            new_bytes = mem_huge_pages(new_bytes / PAGESIZE) * PAGESIZE;
+        } else if (Prefault == TRUE)
+            populate = MAP_POPULATE;
+        cp = mmap(NULL, new_bytes + slack, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+        if (cp == MAP_FAILED)
+            return NULL;
+        if (slack > 0) {
+            aligned = (char *) (((uintptr_t) cp + HUGE_PAGE_BYTES - 1)
+                    & ~((uintptr_t) HUGE_PAGE_BYTES - 1));
+            if (aligned > cp)
+                munmap(cp, aligned - cp);
+            if (cp + slack > aligned)
+                munmap(aligned + new_bytes, cp + slack - aligned);
+            cp = aligned;
+        }
+        H->num_mmap_calls++;
+    } else {
+        //sbrk is not thread-safe, and every heap shares the break
+        if (ThreadSafe == TRUE)
+            pthread_mutex_lock(&SbrkLock);
+        cp = mem_reuse(new_bytes);
+        if (cp == NULL) {
+            //pad to a 2 MB boundary before another heap can move the break
+            if (HugePages == TRUE)
+                new_bytes = mem_huge_pages(new_bytes / PAGESIZE) * PAGESIZE;
+            cp = sbrk(new_bytes);
+        }
+        if (ThreadSafe == TRUE)
+            pthread_mutex_unlock(&SbrkLock);
+        if (cp == (char *) -1)
+            return NULL;
+        //a retired region counts too, so replays report the same growth
+        H->num_sbrk_calls++;
+    }
+    //advise before prefaulting so the faults can map huge pages
+    if (HugePages == TRUE)
+        H->huge_bytes += mem_advise_huge(cp, new_bytes);
+    if (Prefault == TRUE && populate == 0)
+        mem_prefault(cp, new_bytes);
+    new_test1 = (chunk_t *) cp;
+    H->num_pages += (new_bytes / PAGESIZE);
+    *new_bytes_p = new_bytes;
+
+    return new_test1;
+}
+
+/* mem_reuse
+ * takes new_bytes from the front of a region on the Retired list.  Its
+ * fencepost stays at the end, so what is left over stays on the list.  The
+ * caller holds SbrkLock in thread-safe mode.
+ *
+ * returns the start of the bytes, NULL if no retired region is big enough
+ */
+char *mem_reuse(int new_bytes)
+{
+    chunk_t *end, **prev;
+    char *cp;
+    int units = new_bytes / sizeof(chunk_t);
+
+    for (prev = &Retired; (end = *prev) != NULL; prev = &LINK(end)) {
+        if (end->size < units)
+            continue;
+        cp = (char *) REGION_START(end);
+        if (end->size == units)
+            *prev = LINK(end);
+        else
+            end->size -= units;
+        return cp;
+    }
+    return NULL;
+}
+
+/* mem_huge_pages
+ * rounds a growth of pageCount pages so the region ends on a 2 MB
+ * boundary.  A mapping starts on one, so it grows by whole huge pages; the
+ * break of sbrk is padded to one, so every later contiguous region is
+ * aligned too.  For sbrk the caller holds SbrkLock in thread-safe mode, so
+ * the break cannot move between the read and the extension.
+ *
+ * returns the number of pages to ask morecore for
+ */
+int mem_huge_pages(int pageCount)
+{
+    uintptr_t end;
+    int hugePages = HUGE_PAGE_BYTES / PAGESIZE;
+
+    if (PageSource == MMAP_SOURCE)
+        return (pageCount + hugePages - 1) / hugePages * hugePages;
+    end = (uintptr_t) sbrk(0) + (uintptr_t) pageCount * PAGESIZE;
+    return pageCount + ((-end) & (HUGE_PAGE_BYTES - 1)) / PAGESIZE;
+}
+
+/* mem_advise_huge
+ * marks the aligned 2 MB spans of the bytes at start as eligible for
+ * transparent huge pages
+ *
+ * returns the number of bytes advised, 0 if there are none or madvise
+ * failed
+ */
+long mem_advise_huge(char *start, long bytes)
+{
+    uintptr_t first, last;
+
+    first = ((uintptr_t) start + HUGE_PAGE_BYTES - 1) & ~((uintptr_t) HUGE_PAGE_BYTES - 1);
+    last = ((uintptr_t) start + bytes) & ~((uintptr_t) HUGE_PAGE_BYTES - 1);
+    if (last <= first || madvise((char *) first, last - first, MADV_HUGEPAGE) != 0)
+        return 0;
+    return last - first;
+}
+
+/* mem_prefault
+ * faults in the fresh pages at start by writing a zero to each, so the
+ * first allocations from them do not take the faults
+ */
+void mem_prefault(char *start, long bytes)
+{
+    long i;
+
+    for (i = 0; i < bytes; i += PAGESIZE)
+        *(volatile char *) (start + i) = 0;
+}
+
+/* mem_map_chunk
+ * gives a large request a mapping of its own instead of carving it from
+ * the heap, so its pages go back to the OS as soon as it is freed.
+ *
+ * returns the chunk, marked in use and mmapped, or NULL if mmap failed
+ */
+chunk_t *mem_map_chunk(mem_heap_t *H, int units)
+{
+    chunk_t *p;
+    long bytes = ((long) units * sizeof(chunk_t) + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    LINK(p) = NULL;
+    p->size = bytes / sizeof(chunk_t);
+    p->flags = CHUNK_INUSE | CHUNK_MMAPPED;
+
+    mem_lock(H);
+    H->num_mmap_calls++;
+    H->num_mappings++;
+    H->mmapped_bytes += bytes;
+    mem_unlock(H);
+
+    return p;
+}
+
+/* mem_unmap_chunk
+ * releases a chunk made by mem_map_chunk for heap H.  The caller holds the
+ * lock of H in thread-safe mode.
+ */
+void mem_unmap_chunk(mem_heap_t *H, chunk_t *p)
+{
+    long bytes = (long) p->size * sizeof(chunk_t);
+
+    assert(p->flags & CHUNK_MMAPPED);
+    H->num_mappings--;
+    H->mmapped_bytes -= bytes;
+    munmap(p, bytes);
+}
+
+/* mem_init
+ * empties the dummy list, every bin, the TLSF lists and the size tree of
+ * H.  Called before the first chunk is linked and when the free chunks are
+ * refiled.
+ */
+void mem_init(mem_heap_t *H)
+{
+    chunk_t *head;
+    int i;
+
+    for (i = 0; i < NUM_BINS; i++) {
+        LINK(H->bins[i]) = H->bins[i];
+        H->bins[i][0].size = 0;
+        H->bins[i][0].flags = CHUNK_INUSE;
+        PREV_LINK(H->bins[i]) = H->bins[i];
+    }
+    for (i = 0; i < TLSF_FL_COUNT * TLSF_SL_COUNT; i++) {
+        head = H->tlsf[i / TLSF_SL_COUNT][i % TLSF_SL_COUNT];
+        LINK(head) = head;
+        head->size = 0;
+        head->flags = CHUNK_INUSE;
+        PREV_LINK(head) = head;
+    }
+    H->tlsf_fl = 0;
+    memset(H->tlsf_sl, 0, sizeof(H->tlsf_sl));
+    LINK(H->dummy) = H->dummy;
+    H->dummy[0].size = 0;
+    H->dummy[0].flags = CHUNK_INUSE;
+    PREV_LINK(H->dummy) = H->dummy;
+    H->rover = H->dummy;
+    H->size_tree = NULL;
+    H->bins_ready = TRUE;
+}
+
+/* mem_link
+ * puts free chunk p on the list the active policy of H files it under.
+ * Chunks on the dummy list are inserted just before the rover so that a
+ * next-fit search reaches them last.
+ */
+void mem_link(mem_heap_t *H, chunk_t *p)
+{
+    chunk_t *head;
+    int fl, sl;
+
+    if (IN_TLSF(H)) {
+        mem_tlsf_index(p->size, &fl, &sl);
+        head = H->tlsf[fl][sl];
+        LINK(p) = LINK(head);
+        PREV_LINK(p) = head;
+        H->tlsf_fl |= 1U << fl;
+        H->tlsf_sl[fl] |= 1U << sl;
+    } else if (IN_BINS(H, p->size)) {
+        head = H->bins[p->size];
+        LINK(p) = LINK(head);
+        PREV_LINK(p) = head;
+    } else {
+        head = H->rover;
+        LINK(p) = head;
+        PREV_LINK(p) = PREV_LINK(head);
+        if (IN_TREE(H, p->size))
+            H->size_tree = mem_tree_insert(H->size_tree, p);
+    }
+    LINK(PREV_LINK(p)) = p;
+    PREV_LINK(LINK(p)) = p;
+}
+
+/* mem_unlink
+ * removes free chunk p from whichever list it is on in O(1), and from
+ * the size tree in O(log n).  A TLSF list left empty has its bit cleared.
+ * A purged chunk stops counting as purged, since its pages fault back in
+ * as soon as they are touched.
+ */
+void mem_unlink(mem_heap_t *H, chunk_t *p)
+{
+    int fl, sl;
+
+    if (p == H->rover)
+        H->rover = LINK(p);
+    LINK(PREV_LINK(p)) = LINK(p);
+    PREV_LINK(LINK(p)) = PREV_LINK(p);
+    if (IN_TREE(H, p->size))
+        H->size_tree = mem_tree_remove(H->size_tree, p);
+    //once reused or merged its pages count as resident again
+    if (p->flags & CHUNK_PURGED) {
+        H->purged_bytes -= mem_purgeable(p, NULL);
+        p->flags &= ~CHUNK_PURGED;
+    }
+    //p was alone when both its neighbours are the list head
+    if (IN_TLSF(H) && LINK(p) == PREV_LINK(p)) {
+        mem_tlsf_index(p->size, &fl, &sl);
+        H->tlsf_sl[fl] &= ~(1U << sl);
+        if (H->tlsf_sl[fl] == 0)
+            H->tlsf_fl &= ~(1U << fl);
+    }
+}
+
+/* mem_set_free
+ * writes the boundary tags of a free chunk: clears the in-use bit, copies
+ * the size into the footer and tells the next chunk its neighbour is free.
+ * With decay on the chunk is also stamped with the time.
+ */
+void mem_set_free(chunk_t *p)
+{
+    p->flags &= ~CHUNK_INUSE;
+    FOOTER(p)->size = p->size;
+    MARK_PREV_FREE(NEXT_CHUNK(p));
+    if (DecayMillis > 0)
+        FREED_AT(p) = mem_now_ms();
+}
+
+/* mem_relink_all
+ * refiles every free chunk of H after its search policy has been changed.
+ * The free chunks are found by walking the heap, so nothing depends on
+ * where the old policy kept them.
+ */
+void mem_relink_all(mem_heap_t *H)
+{
+    chunk_t *p, *end;
+
+    H->active_policy = H->search_policy;
+    mem_init(H);
+    for (end = H->top; end != NULL; end = LINK(end)) {
+        for (p = REGION_START(end); p < end; p = NEXT_CHUNK(p)) {
+            if (!(p->flags & CHUNK_INUSE))
+                mem_link(H, p);
+        }
+    }
+}
+
+/* mem_tree_cmp
+ * orders free chunks by size, then by address, so every key is unique
+ *
+ * RETURNS negative, zero or positive as a is before, equal to or after b
+ */
+int mem_tree_cmp(chunk_t *a, chunk_t *b)
+{
+    if (a->size != b->size)
+        return (a->size < b->size) ? -1 : 1;
+    if (a != b)
+        return (a < b) ? -1 : 1;
+    return 0;
+}
+
+/* RETURNS the height of a size tree node, 0 for NULL */
+int mem_tree_height(chunk_t *node)
+{
+    if (node == NULL)
+        return 0;
+    return TREE_HEIGHT(node);
+}
+
+/* right rotates the size subtree rooted at y
+ *
+ * RETURNS the new root of the subtree
+ */
+chunk_t *mem_tree_rotate_right(chunk_t *y)
+{
+    chunk_t *x = TREE_LEFT(y);
+
+    TREE_LEFT(y) = TREE_RIGHT(x);
+    TREE_RIGHT(x) = y;
+    TREE_HEIGHT(y) = 1 + MEM_MAX(mem_tree_height(TREE_LEFT(y)), mem_tree_height(TREE_RIGHT(y)));
+    TREE_HEIGHT(x) = 1 + MEM_MAX(mem_tree_height(TREE_LEFT(x)), mem_tree_height(TREE_RIGHT(x)));
+    return x;
+}
+
+/* left rotates the size subtree rooted at x
+ *
+ * RETURNS the new root of the subtree
+ */
+chunk_t *mem_tree_rotate_left(chunk_t *x)
+{
+    chunk_t *y = TREE_RIGHT(x);
+
+    TREE_RIGHT(x) = TREE_LEFT(y);
+    TREE_LEFT(y) = x;
+    TREE_HEIGHT(x) = 1 + MEM_MAX(mem_tree_height(TREE_LEFT(x)), mem_tree_height(TREE_RIGHT(x)));
+    TREE_HEIGHT(y) = 1 + MEM_MAX(mem_tree_height(TREE_LEFT(y)), mem_tree_height(TREE_RIGHT(y)));
+    return y;
+}
+
+/* mem_tree_balance
+ * updates the height of node and restores the AVL property with at most
+ * two rotations
+ *
+ * RETURNS the new root of the subtree
+ */
+chunk_t *mem_tree_balance(chunk_t *node)
+{
+    int balance;
+
+    TREE_HEIGHT(node) = 1 + MEM_MAX(mem_tree_height(TREE_LEFT(node)),
+            mem_tree_height(TREE_RIGHT(node)));
+    balance = mem_tree_height(TREE_LEFT(node)) - mem_tree_height(TREE_RIGHT(node));
+
+    if (balance > 1) {
+        //left right
+        if (mem_tree_height(TREE_LEFT(TREE_LEFT(node)))
+                < mem_tree_height(TREE_RIGHT(TREE_LEFT(node))))
+            TREE_LEFT(node) = mem_tree_rotate_left(TREE_LEFT(node));
+        //left left
+        return mem_tree_rotate_right(node);
+    }
+    if (balance < -1) {
+        //right left
+        if (mem_tree_height(TREE_RIGHT(TREE_RIGHT(node)))
+                < mem_tree_height(TREE_LEFT(TREE_RIGHT(node))))
+            TREE_RIGHT(node) = mem_tree_rotate_right(TREE_RIGHT(node));
+        //right right
+        return mem_tree_rotate_left(node);
+    }
+    return node;
+}
+
+/* mem_tree_insert
+ * adds free chunk p to the size subtree rooted at node
+ *
+ * RETURNS the new root of the subtree
+ */
+chunk_t *mem_tree_insert(chunk_t *node, chunk_t *p)
+{
+    if (node == NULL) {
+        TREE_LEFT(p) = TREE_RIGHT(p) = NULL;
+        TREE_HEIGHT(p) = 1;
+        return p;
+    }
+    if (mem_tree_cmp(p, node) < 0)
+        TREE_LEFT(node) = mem_tree_insert(TREE_LEFT(node), p);
+    else
+        TREE_RIGHT(node) = mem_tree_insert(TREE_RIGHT(node), p);
+    return mem_tree_balance(node);
+}
+
+/* mem_tree_remove
+ * removes free chunk p from the size subtree rooted at node.  A node with
+ * two children is replaced by its in-order successor.
+ *
+ * RETURNS the new root of the subtree
+ */
+chunk_t *mem_tree_remove(chunk_t *node, chunk_t *p)
+{
+    chunk_t *succ;
+    int cmp;
+
+    assert(node != NULL);
+    cmp = mem_tree_cmp(p, node);
+    if (cmp < 0) {
+        TREE_LEFT(node) = mem_tree_remove(TREE_LEFT(node), p);
+    } else if (cmp > 0) {
+        TREE_RIGHT(node) = mem_tree_remove(TREE_RIGHT(node), p);
+    } else {
+        if (TREE_LEFT(node) == NULL)
+            return TREE_RIGHT(node);
+        if (TREE_RIGHT(node) == NULL)
+            return TREE_LEFT(node);
+        succ = TREE_RIGHT(node);
+        while (TREE_LEFT(succ) != NULL)
+            succ = TREE_LEFT(succ);
+        TREE_RIGHT(succ) = mem_tree_remove(TREE_RIGHT(node), succ);
+        TREE_LEFT(succ) = TREE_LEFT(node);
+        node = succ;
+    }
+    return mem_tree_balance(node);
+}
+
+/* mem_tree_ceiling
+ * RETURNS the smallest (lowest addressed on ties) free chunk in the size
+ * tree of H with at least units units, or NULL
+ */
+chunk_t *mem_tree_ceiling(mem_heap_t *H, int units)
+{
+    chunk_t *node = H->size_tree, *best = NULL;
+
+    while (node != NULL) {
+        if (node->size >= units) {
+            best = node;
+            node = TREE_LEFT(node);
+        } else {
+            node = TREE_RIGHT(node);
+        }
+    }
+    return best;
+}
+
+/* mem_tlsf_index
+ * finds the TLSF list, first level fl and second level sl, that a free
+ * chunk of size units belongs on
+ */
+void mem_tlsf_index(int size, int *fl, int *sl)
+{
+    int msb;
+
+    if (size < TLSF_SL_COUNT) {
+        *fl = 0;
+        *sl = size;
+    } else {
+        msb = 31 - __builtin_clz(size);
+        *fl = msb - TLSF_SL_LOG2 + 1;
+        *sl = (size >> (msb - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+    }
+}
+
+/* mem_list_head
+ * RETURNS the sentinel of size-class list i of H: bin i for i below
+ * NUM_BINS, then the TLSF lists level by level
+ */
+chunk_t *mem_list_head(mem_heap_t *H, int i)
+{
+    if (i < NUM_BINS)
+        return H->bins[i];
+    i -= NUM_BINS;
+    return H->tlsf[i / TLSF_SL_COUNT][i % TLSF_SL_COUNT];
+}
+
+/* mem_tlsf_find
+ * good fit in O(1): the request is rounded up to the start of the next
+ * TLSF list, so every chunk on that list or a later one fits, and the
+ * first non-empty such list is found with two bit scans.  The chunk may
+ * be up to one slice larger than the best fit.
+ *
+ * returns the first chunk of that list, or NULL if every list is empty
+ */
+chunk_t *mem_tlsf_find(mem_heap_t *H, int units)
+{
+    unsigned int bits;
+    int fl, sl;
+
+    if (units >= TLSF_SL_COUNT)
+        units += (1 << (31 - __builtin_clz(units) - TLSF_SL_LOG2)) - 1;
+    mem_tlsf_index(units, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+        return NULL;
+
+    bits = H->tlsf_sl[fl] & (~0U << sl);
+    if (bits == 0) {
+        //nothing left on this level: the next non-empty level
+        bits = H->tlsf_fl & (~0U << (fl + 1));
+        if (bits == 0)
+            return NULL;
+        fl = __builtin_ctz(bits);
+        bits = H->tlsf_sl[fl];
+    }
+    sl = __builtin_ctz(bits);
+    return LINK(H->tlsf[fl][sl]);
+}
+
+/* mem_find
+ * returns a free chunk of H of at least units units chosen by the active
+ * policy, or NULL if there is none.  The chunk is not removed.
+ */
+chunk_t *mem_find(mem_heap_t *H, int units)
+{
+    chunk_t *p, *marker;
+    int i;
+
+    if (IN_TLSF(H))
+        return mem_tlsf_find(H, units);
+
+    if (IN_BINS(H, units)) {
+        //the smallest non-empty bin that fits
+        for (i = units; i < NUM_BINS; i++) {
+            if (LINK(H->bins[i]) != H->bins[i])
+                return LINK(H->bins[i]);
+        }
+    }
+
+    if (H->active_policy == BEST_FIT) {
+#ifdef MEM_BEST_FIT_SCAN
+        //the whole list, stopping early only on an exact fit
+        chunk_t *best = NULL;
+
+        for (p = LINK(H->dummy); p != H->dummy; p = LINK(p)) {
+            if (p->size == units)
+                return p;
+            if (p->size > units && (best == NULL || p->size < best->size))
+                best = p;
+        }
+        return best;
+#else
+        return mem_tree_ceiling(H, units);
+#endif
+    }
+
+    //first fit, starting from where the last search stopped
+    marker = H->rover;
+    p = H->rover;
+    do {
+        if (p->size >= units) {
+            H->rover = p;
+            return p;
+        }
+        p = LINK(p);
+    } while (p != marker);
+
+    return NULL;
+}
+
+/* mem_take
+ * allocates the first units units of free chunk p.  If the remainder is
+ * large enough to be a chunk of its own it goes back on a free list.
+ *
+ * returns the allocated chunk
+ */
+chunk_t *mem_take(mem_heap_t *H, chunk_t *p, int units)
+{
+    chunk_t *remainder;
+
+    assert(!(p->flags & CHUNK_INUSE) && p->size >= units);
+    mem_unlink(H, p);
+
+    if (p->size - units >= MIN_CHUNK) {
+        remainder = p + units;
+        remainder->size = p->size - units;
+        remainder->flags = 0;
+        mem_set_free(remainder);
+        mem_link(H, remainder);
+        if (!IN_BINS(H, remainder->size) && !IN_TLSF(H))
+            H->rover = remainder;
+        p->size = units;
+    } else {
+        CLEAR_PREV_FREE(NEXT_CHUNK(p));
+    }
+    p->flags |= CHUNK_INUSE;
+    LINK(p) = NULL;
+
+    return p;
+}
+
+/* mem_release
+ * frees the in-use chunk p, merging it with free physical neighbours when
+ * coalescing is on for H, and links the result on a free list.
+ *
+ * returns the free chunk that now contains p
+ */
+chunk_t *mem_release(mem_heap_t *H, chunk_t *p)
+{
+    chunk_t *neighbour;
+
+    assert(p->flags & CHUNK_INUSE);
+
+    if (H->coalescing == TRUE) {
+        neighbour = NEXT_CHUNK(p);
+        if (!(neighbour->flags & CHUNK_INUSE)) {
+            mem_unlink(H, neighbour);
+            p->size += neighbour->size;
+        }
+        if (p->flags & CHUNK_PREV_FREE) {
+            neighbour = PREV_CHUNK(p);
+            mem_unlink(H, neighbour);
+            neighbour->size += p->size;
+            p = neighbour;
+        }
+    }
+    mem_set_free(p);
+    mem_link(H, p);
+
+    //decay is driven by releases: the clock is read every DECAY_TICKS
+    if (DecayMillis > 0 && ++H->decay_ticks >= DECAY_TICKS) {
+        H->decay_ticks = 0;
+        if (mem_now_ms() - H->last_decay >= (unsigned int) DecayMillis)
+            mem_decay(H, DecayMillis);
+    }
+
+    return p;
+}
+
+/* mem_now_ms
+ * RETURNS a millisecond clock; it wraps, so only differences are meaningful
+ */
+unsigned int mem_now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000U + now.tv_nsec / 1000000;
+}
+
+/* mem_purgeable
+ * finds the whole pages inside free chunk p that can go back to the OS:
+ * everything but the header, the back link, the tree links and the footer.
+ *
+ * returns their length in bytes, 0 if there are none, and sets *start to
+ * the first of them unless start is NULL
+ */
+long mem_purgeable(chunk_t *p, char **start)
+{
+    uintptr_t first, last;
+
+    first = ((uintptr_t) (p + KEEP_UNITS) + PAGESIZE - 1) & ~((uintptr_t) PAGESIZE - 1);
+    last = (uintptr_t) FOOTER(p) & ~((uintptr_t) PAGESIZE - 1);
+    if (p->size <= KEEP_UNITS || last <= first)
+        return 0;
+    if (start != NULL)
+        *start = (char *) first;
+    return last - first;
+}
+
+/* mem_decay
+ * hands the whole pages of every free chunk of H that has been idle for
+ * idleMillis or more back to the OS with madvise.  The pages stay mapped,
+ * and read as zeros when the chunk is used again.  The caller holds the
+ * lock of H in thread-safe mode.
+ */
+void mem_decay(mem_heap_t *H, int idleMillis)
+{
+    chunk_t *p, *end;
+    unsigned int now = mem_now_ms();
+    char *start;
+    long bytes;
+
+    H->last_decay = now;
+    for (end = H->top; end != NULL; end = LINK(end)) {
+        for (p = REGION_START(end); p < end; p = NEXT_CHUNK(p)) {
+            if (p->flags & (CHUNK_INUSE | CHUNK_PURGED))
+                continue;
+            if (now - (unsigned int) FREED_AT(p) < (unsigned int) idleMillis)
+                continue;
+            bytes = mem_purgeable(p, &start);
+            if (bytes > 0 && madvise(start, bytes, MADV_DONTNEED) == 0) {
+                p->flags |= CHUNK_PURGED;
+                H->purged_bytes += bytes;
+            }
+        }
+    }
+}
+
+/* Mem_heap_decay
+ * runs a decay pass over heap H now instead of waiting for the next one.
+ * With DecayMillis 0 every whole free page goes back to the OS.
+ */
+void Mem_heap_decay(mem_heap_t *H)
+{
+    mem_lock(H);
+    mem_decay(H, DecayMillis);
+    mem_unlock(H);
+}
+
+/* Mem_decay
+ * Mem_heap_decay for the default heap
+ */
+void Mem_decay(void)
+{
+    Mem_heap_decay(&DefaultHeap);
+}
+
+/* mem_grow
+ * gets pageCount or more pages from morecore and frees them into heap H.
+ * When the new pages directly follow the previous region of H its
+ * fencepost is reused, so the new space can merge with a free chunk at the
+ * old top.
+ *
+ * returns the free chunk holding the new space, or NULL if morecore failed
+ */
+chunk_t *mem_grow(mem_heap_t *H, int pageCount)
+{
+    chunk_t *p, *fence;
+    int units, bytes = pageCount * PAGESIZE;
+    int mapped = (PageSource == MMAP_SOURCE) ? CHUNK_MMAPPED : 0;
+
+    p = morecore(H, &bytes);
+    if (p == NULL)
+        return NULL;
+    units = bytes / sizeof(chunk_t);
+
+    //a region is all sbrk or all mmap pages, so it can be given back whole
+    if (H->top != NULL && H->top + FENCE_UNITS == p
+            && (H->top->flags & CHUNK_MMAPPED) == mapped) {
+        //contiguous with the last region: the old fencepost heads the chunk
+        p = H->top;
+        fence = p + units;
+        LINK(fence) = LINK(H->top);
+        fence->size = H->top->size + units;
+        p->flags = (H->top->flags & CHUNK_PREV_FREE) | CHUNK_INUSE;
+    } else {
+        fence = p + units - FENCE_UNITS;
+        LINK(fence) = H->top;
+        fence->size = units;
+        units -= FENCE_UNITS;
+        p->flags = CHUNK_INUSE;
+    }
+    fence->flags = CHUNK_INUSE | CHUNK_FENCE | mapped;
+    H->top = fence;
+
+    p->size = units;
+    return mem_release(H, p);
+}
+
+/* mem_alloc_chunk
+ * allocates a chunk of units units from heap H, growing it with morecore
+ * when no free chunk fits.  With geometric growth on, morecore is asked
+ * for more than the chunk needs; mem_grow frees the surplus into the heap,
+ * merged with the old top chunk when the new pages are contiguous.  The
+ * caller holds the lock of H in thread-safe mode.
+ *
+ * returns the allocated chunk, or NULL if morecore failed
+ */
+chunk_t *mem_alloc_chunk(mem_heap_t *H, int units)
+{
+    assert(H->rover != NULL && LINK(H->rover) != NULL);
+
+    int pageCount;
+    chunk_t *p;
+
+    if (H->search_policy != H->active_policy)
+        mem_relink_all(H);
+
+    p = mem_find(H, units);
+    if (p == NULL) {
+        //pages needed to hold the chunk and a fencepost
+        pageCount = ((units + FENCE_UNITS) * sizeof(chunk_t) + PAGESIZE - 1) / PAGESIZE;
+        if (GrowMaxPages > 0) {
+            //geometric growth: each step twice the last, within the bounds
+            if (H->grow_pages == 0)
+                H->grow_pages = MEM_MAX(GrowMinPages, 1);
+            else if (H->grow_pages < GrowMaxPages)
+                H->grow_pages = MEM_MAX(GrowMinPages, MEM_MIN(2 * H->grow_pages, GrowMaxPages));
+            pageCount = MEM_MAX(pageCount, H->grow_pages);
+        }
+        p = mem_grow(H, pageCount);
+        if (p == NULL)
+            return NULL;
+    }
+
+    return mem_take(H, p, units);
+}
+
+/* mem_lock, mem_unlock
+ * guard heap H when ThreadSafe is TRUE.  Once locked, the default heap
+ * picks up any change to SearchPolicy and Coalescing, and has its lists
+ * set up the first time.
+ */
+void mem_lock(mem_heap_t *H)
+{
+    if (ThreadSafe == TRUE)
+        pthread_mutex_lock(&H->lock);
+    if (H->bins_ready == FALSE)
+        mem_init(H);
+    if (H == &DefaultHeap) {
+        H->search_policy = SearchPolicy;
+        H->coalescing = Coalescing;
+    }
+}
+
+void mem_unlock(mem_heap_t *H)
+{
+    if (ThreadSafe == TRUE)
+        pthread_mutex_unlock(&H->lock);
+}
+
+/* mem_cache_key
+ * creates the key whose destructor flushes a thread's cache when the
+ * thread exits.  Run once through pthread_once.
+ */
+void mem_cache_key(void)
+{
+    pthread_key_create(&CacheKey, mem_cache_exit);
+}
+
+/* mem_cache_exit
+ * key destructor: hands the exiting thread's cached chunks back to the heap
+ */
+void mem_cache_exit(void *unused)
+{
+    (void) unused;
+    Mem_thread_flush();
+}
+
+/* mem_cache_drain
+ * returns up to count chunks from this thread's cache bin to the default
+ * heap under a single lock.
+ */
+void mem_cache_drain(int bin, int count)
+{
+    chunk_t *p;
+
+    mem_lock(&DefaultHeap);
+    while (count-- > 0 && Cache[bin] != NULL) {
+        p = Cache[bin];
+        Cache[bin] = LINK(p);
+        CacheCount[bin]--;
+        atomic_fetch_sub(&CachedBytes, (long) p->size * sizeof(chunk_t));
+        mem_release(&DefaultHeap, p);
+    }
+    mem_unlock(&DefaultHeap);
+}
+
+/* Mem_thread_flush
+ * returns every chunk in the calling thread's cache to the default heap.
+ * Called automatically when a thread exits.
+ */
+void Mem_thread_flush(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_BINS; i++) {
+        if (Cache[i] != NULL)
+            mem_cache_drain(i, CacheCount[i]);
+    }
+}
+
+/* Mem_heap_create
+ * makes an empty heap with its own free lists, regions and statistics.
+ * The heap header is taken from the default heap.
+ *
+ * search_policy - FIRST_FIT, BEST_FIT, SEGREGATED_FIT or TLSF_FIT
+ * coalescing - TRUE if chunks freed into the heap are coalesced
+ *
+ * returns the heap, or NULL if the header cannot be allocated
+ */
+mem_heap_t *Mem_heap_create(const int search_policy, const int coalescing)
+{
+    mem_heap_t *H;
+
+    H = (mem_heap_t *) Mem_alloc(sizeof(mem_heap_t));
+    if (H == NULL)
+        return NULL;
+
+    memset(H, 0, sizeof(mem_heap_t));
+    mem_init(H);
+    H->search_policy = search_policy;
+    H->active_policy = search_policy;
+    H->coalescing = coalescing;
+    pthread_mutex_init(&H->lock, NULL);
+    H->owner = pthread_self();
+    atomic_init(&H->remote_frees, NULL);
+    return H;
+}
+
+/* Mem_heap_destroy
+ * gives back every region of heap H and frees its header.  A region of
+ * mapped pages is unmapped.  The break cannot move back past the regions
+ * of other heaps, so a region from sbrk goes on the Retired list instead,
+ * with all but the page of its fencepost handed back to the OS, for the
+ * next heap that grows.  Objects still allocated from H become invalid;
+ * large ones with a mapping of their own are not tracked and must be
+ * freed first.
+ */
+void Mem_heap_destroy(mem_heap_t *H)
+{
+    chunk_t *end, *next;
+    uintptr_t first, last;
+
+    if (H == NULL)
+        return;
+    assert(H != &DefaultHeap && H->num_mappings == 0);
+    if (ThreadSafe == TRUE)
+        pthread_mutex_lock(&SbrkLock);
+    for (end = H->top; end != NULL; end = next) {
+        next = LINK(end);
+        if (end->flags & CHUNK_MMAPPED) {
+            munmap(REGION_START(end), (long) end->size * sizeof(chunk_t));
+            continue;
+        }
+        first = ((uintptr_t) REGION_START(end) + PAGESIZE - 1) & ~((uintptr_t) PAGESIZE - 1);
+        last = (uintptr_t) end & ~((uintptr_t) PAGESIZE - 1);
+        if (last > first)
+            madvise((char *) first, last - first, MADV_DONTNEED);
+        LINK(end) = Retired;
+        Retired = end;
+    }
+    if (ThreadSafe == TRUE)
+        pthread_mutex_unlock(&SbrkLock);
+    pthread_mutex_destroy(&H->lock);
+    Mem_free(H);
+}
+
+/* Mem_heap_adopt
+ * makes the calling thread the owner of heap H
+ */
+void Mem_heap_adopt(mem_heap_t *H)
+{
+    mem_lock(H);
+    H->owner = pthread_self();
+    mem_unlock(H);
+}
+
+/* mem_remote_push
+ * hands the in-use chunk p to the owner of H without taking its lock.
+ * Any number of threads may push at once; only the owner's drain takes
+ * chunks off, and it takes them all, so a CAS on the list head suffices.
+ */
+void mem_remote_push(mem_heap_t *H, chunk_t *p)
+{
+    chunk_t *head = atomic_load_explicit(&H->remote_frees, memory_order_relaxed);
+
+    do {
+        LINK(p) = head;
+    } while (!atomic_compare_exchange_weak_explicit(&H->remote_frees, &head, p,
+                memory_order_release, memory_order_relaxed));
+}
+
+/* mem_remote_drain
+ * releases every chunk other threads have pushed on the remote list of H
+ * as one batch.  The caller holds the lock of H.
+ */
+void mem_remote_drain(mem_heap_t *H)
+{
+    chunk_t *p, *next;
+
+    p = atomic_exchange_explicit(&H->remote_frees, NULL, memory_order_acquire);
+    for (; p != NULL; p = next) {
+        next = LINK(p);
+        mem_release(H, p);
+        H->num_remote_frees++;
+    }
+}
+
+/* Mem_heap_free
+ * deallocates the space pointed to by return_ptr, which must have come
+ * from heap H; it does nothing if return_ptr is NULL.
+ *
+ * The chunk is merged with its free physical neighbours using the
+ * boundary tags, so the cost does not depend on the length of the free
+ * list.  In thread-safe mode a thread that does not own H only queues the
+ * chunk for the owner, lock-free.
+ */
+void Mem_heap_free(mem_heap_t *H, void *return_ptr)
+{
+    if (return_ptr != NULL) {
+        chunk_t *dumChunk = (chunk_t *) return_ptr - 1;
+
+        if (ThreadSafe == TRUE && H != &DefaultHeap
+                && !(OWNER_FLAGS(dumChunk) & CHUNK_MMAPPED)
+                && !pthread_equal(H->owner, pthread_self())) {
+            assert(OWNER_FLAGS(dumChunk) & CHUNK_INUSE);
+            mem_remote_push(H, dumChunk);
+            return;
+        }
+
+        mem_lock(H);
+        if (dumChunk->flags & CHUNK_SAMPLED)
+            mem_unsample(dumChunk);
+        if (dumChunk->flags & CHUNK_MMAPPED)
+            mem_unmap_chunk(H, dumChunk);
+        else
+            mem_release(H, dumChunk);
+        mem_unlock(H);
+    }
+}
+
+/* Mem_heap_free_batch
+ * deallocates the n objects in ptrs, all from heap H, under a single lock.
+ * NULL entries are skipped.
+ *
+ * Objects that follow each other in ptrs and lie back to back in the heap
+ * are merged into one chunk before it is released, so such a run costs
+ * one list (or size tree) update instead of one per object.  Objects in
+ * any other order are released one by one, as Mem_free would.  With
+ * coalescing off every object is released on its own.
+ */
+void Mem_heap_free_batch(mem_heap_t *H, void **ptrs, const int n)
+{
+    chunk_t *run = NULL, *p;
+    int i;
+
+    mem_lock(H);
+    for (i = 0; i < n; i++) {
+        if (ptrs[i] == NULL)
+            continue;
+        if (H == &DefaultHeap && TraceFile != NULL)
+            mem_trace(ptrs[i], 0);
+        p = (chunk_t *) ptrs[i] - 1;
+        assert(p->flags & CHUNK_INUSE);
+        if (p->flags & CHUNK_SAMPLED)
+            mem_unsample(p);
+        if (p->flags & CHUNK_MMAPPED) {
+            mem_unmap_chunk(H, p);
+        } else if (run != NULL && H->coalescing == TRUE && NEXT_CHUNK(run) == p) {
+            //p's header becomes part of the run's payload
+            run->size += p->size;
+        } else {
+            if (run != NULL)
+                mem_release(H, run);
+            run = p;
+        }
+    }
+    if (run != NULL)
+        mem_release(H, run);
+    mem_unlock(H);
+}
+
+/* Mem_free_batch
+ * deallocates the n objects in ptrs from the default heap, like calling
+ * Mem_free on each but with one lock and one list update per run of
+ * neighbouring objects.  The objects bypass the thread cache.
+ */
+void Mem_free_batch(void **ptrs, const int n)
+{
+    Mem_heap_free_batch(&DefaultHeap, ptrs, n);
+}
+
+/* Mem_free
+ * deallocates the space pointed to by return_ptr in the default heap; it
+ * does nothing if return_ptr is NULL.
+ *
+ * In thread-safe mode small chunks are first kept in the thread's cache;
+ * only a full cache bin takes the heap lock, and then returns half of its
+ * chunks at once.
+ */
+void Mem_free(void *return_ptr)
+{
+    if (return_ptr != NULL) {
+        chunk_t *dumChunk = (chunk_t *) return_ptr - 1;
+
+        if (TraceFile != NULL)
+            mem_trace(return_ptr, 0);
+
+        if (ThreadSafe == TRUE && dumChunk->size < NUM_BINS
+                && !(OWNER_FLAGS(dumChunk) & CHUNK_MMAPPED)) {
+            if (OWNER_FLAGS(dumChunk) & CHUNK_SAMPLED) {
+                mem_lock(&DefaultHeap);
+                mem_unsample(dumChunk);
+                mem_unlock(&DefaultHeap);
+            }
+            if (CacheCount[dumChunk->size] == CACHE_MAX)
+                mem_cache_drain(dumChunk->size, CACHE_MAX / 2);
+            LINK(dumChunk) = Cache[dumChunk->size];
+            Cache[dumChunk->size] = dumChunk;
+            CacheCount[dumChunk->size]++;
+            atomic_fetch_add(&CachedBytes, (long) dumChunk->size * sizeof(chunk_t));
+            return;
+        }
+
+        Mem_heap_free(&DefaultHeap, return_ptr);
+    }
+}
+
+/* Mem_heap_alloc
+ * returns a pointer to space in heap H for an object of size nbytes, or
+ * NULL if the request cannot be satisfied.  The memory is uninitialized.
+ *
+ * This function assumes that the heap has a rover that points to some
+ * item in its free list.  The rover starts at the dummy block whose size
+ * is zero, so this block can never be removed from the list.  The rover
+ * can never be null.
+ */
+void *Mem_heap_alloc(mem_heap_t *H, const int nbytes)
+{
+    assert(nbytes > 0);
+
+    int unitNum = 0;
+    chunk_t *test1;
+
+    if (nbytes % sizeof(chunk_t) != 0) {       //if nbytes is not evenly div. by sizeof(chunk_t)
+        unitNum = (nbytes/sizeof(chunk_t))+1;    //   provide number of chunk_t's + 1
+    }
+    else {
+        unitNum = nbytes/sizeof(chunk_t);        //if nbytes is evenly divis. by sizeof(chunk_t)
+    }                                          //   return quotient
+    if (unitNum + 1 < MIN_CHUNK)               //room for the links once freed
+        unitNum = MIN_CHUNK - 1;
+
+    if (MmapThreshold > 0 && nbytes >= MmapThreshold) {
+        test1 = mem_map_chunk(H, unitNum + 1);
+    } else {
+        mem_lock(H);
+        //chunks other threads freed come back before the search
+        if (atomic_load_explicit(&H->remote_frees, memory_order_relaxed) != NULL)
+            mem_remote_drain(H);
+        test1 = mem_alloc_chunk(H, unitNum + 1);
+        mem_unlock(H);
+    }
+
+    if (test1 == NULL)
+        return NULL;
+
+    //assertion checks
+    assert((test1->size - 1) * sizeof(chunk_t) >= (size_t) nbytes);
+    assert(test1->size < unitNum + 1 + MIN_CHUNK || (OWNER_FLAGS(test1) & CHUNK_MMAPPED));
+    assert(OWNER_FLAGS(test1) & CHUNK_INUSE);
+
+    return (test1 + 1);
+}
+
+/* mem_cache_alloc
+ * takes a chunk of units units from this thread's cache.  On a miss the
+ * cache bin is refilled with CACHE_BATCH chunks under one lock.
+ *
+ * returns the payload of the chunk, or NULL if the heap cannot grow
+ */
+void *mem_cache_alloc(int units)
+{
+    int i;
+    chunk_t *test1, *extra;
+
+    if (Cache[units] == NULL) {
+        pthread_once(&CacheOnce, mem_cache_key);
+        pthread_setspecific(CacheKey, Cache);
+        mem_lock(&DefaultHeap);
+        for (i = 1; i < CACHE_BATCH; i++) {
+            extra = mem_alloc_chunk(&DefaultHeap, units);
+            if (extra == NULL || extra->size != units) {
+                if (extra != NULL)
+                    mem_release(&DefaultHeap, extra);
+                break;
+            }
+            LINK(extra) = Cache[units];
+            Cache[units] = extra;
+            CacheCount[units]++;
+            atomic_fetch_add(&CachedBytes, (long) extra->size * sizeof(chunk_t));
+        }
+        test1 = mem_alloc_chunk(&DefaultHeap, units);
+        mem_unlock(&DefaultHeap);
+    } else {
+        test1 = Cache[units];
+        Cache[units] = LINK(test1);
+        CacheCount[units]--;
+        atomic_fetch_sub(&CachedBytes, (long) test1->size * sizeof(chunk_t));
+        LINK(test1) = NULL;
+    }
+
+    if (test1 == NULL)
+        return NULL;
+    assert(OWNER_FLAGS(test1) & CHUNK_INUSE);
+    return (test1 + 1);
+}
+
+/* Mem_alloc
+ * returns a pointer to space in the default heap for an object of size
+ * nbytes, or NULL if the request cannot be satisfied.  The memory is
+ * uninitialized.
+ *
+ * In thread-safe mode a small request is served from the thread's cache
+ * without locking.
+ */
+void *Mem_alloc(const int nbytes)
+{
+    assert(nbytes > 0);
+
+    int units;
+    void *ptr;
+
+    units = REQUEST_UNITS(nbytes);
+    if (ThreadSafe == FALSE || units >= NUM_BINS
+            || (MmapThreshold > 0 && nbytes >= MmapThreshold))
+        ptr = Mem_heap_alloc(&DefaultHeap, nbytes);
+    else
+        ptr = mem_cache_alloc(units);
+
+    if (TraceFile != NULL && ptr != NULL)
+        mem_trace(ptr, nbytes);
+    if (ProfileBytes > 0 && ptr != NULL && (SampleCountdown -= nbytes) < 0)
+        mem_sample(ptr, nbytes);
+    return ptr;
+}
+
+/* Mem_alloc_aligned
+ * returns a pointer to space for an object of size nbytes whose address is
+ * a multiple of alignment, or NULL if the request cannot be satisfied.
+ *
+ * A chunk with room for the request plus the alignment slack is taken from
+ * the heap.  The units in front of the aligned address become a free chunk
+ * of their own and the unused tail is trimmed, so nothing is wasted.
+ * The result carries a normal header and goes back through Mem_free.
  */
+void *Mem_alloc_aligned(const int alignment, const int nbytes)
+{
+    chunk_t *p, *q;
+    int units, alignUnits, lead;
+    uintptr_t addr;
 
-#include <stdlib.h>
-#include <stdio.h>
-#include <assert.h>
-#include <unistd.h>
-#include <math.h>
+    assert(nbytes > 0);
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment <= (int) sizeof(chunk_t))
+        return Mem_alloc(nbytes);
 
-#include "mem.h"
+    units = REQUEST_UNITS(nbytes);
+    alignUnits = alignment / sizeof(chunk_t);
 
-// Global variables required in mem.c only
-static chunk_t Dummy = {&Dummy, 0};
-static chunk_t * Rover = &Dummy;
-static int NumPages = 0;
-static int NumSbrkCalls = 0;
+    mem_lock(&DefaultHeap);
+    // the lead is less than alignUnits + MIN_CHUNK units (see below)
+    p = mem_alloc_chunk(&DefaultHeap, units + alignUnits + MIN_CHUNK);
+    if (p == NULL) {
+        mem_unlock(&DefaultHeap);
+        return NULL;
+    }
 
-// private function prototypes
-void mem_validate(void);
+    addr = ((uintptr_t) (p + 1) + alignment - 1) & ~((uintptr_t) alignment - 1);
+    lead = (addr - (uintptr_t) (p + 1)) / sizeof(chunk_t);
+    while (lead > 0 && lead < MIN_CHUNK)
+        lead += alignUnits;     // too small to free: use the next boundary
 
-/* morecore
- * function to request 1 or more pageCount from the operating system.
+    if (lead > 0) {
+        q = p + lead;
+        q->size = p->size - lead;
+        q->flags = CHUNK_INUSE;
+        LINK(q) = NULL;
+        p->size = lead;
+        mem_release(&DefaultHeap, p);
+        p = q;
+    }
+    mem_trim(&DefaultHeap, p, units);
+    mem_unlock(&DefaultHeap);
+
+    assert(((uintptr_t) (p + 1) & ((uintptr_t) alignment - 1)) == 0);
+    if (TraceFile != NULL)
+        mem_trace(p + 1, nbytes);
+    if (ProfileBytes > 0 && (SampleCountdown -= nbytes) < 0)
+        mem_sample(p + 1, nbytes);
+    return (p + 1);
+}
+
+/* mem_trim
+ * cuts the in-use chunk p down to units units.  The tail is freed (and
+ * merged with a free successor) if it is large enough to be a chunk.
+ */
+void mem_trim(mem_heap_t *H, chunk_t *p, int units)
+{
+    chunk_t *tail;
+
+    assert(p->flags & CHUNK_INUSE);
+    if (p->size - units < MIN_CHUNK)
+        return;
+
+    tail = p + units;
+    tail->size = p->size - units;
+    tail->flags = CHUNK_INUSE;
+    p->size = units;
+    mem_release(H, tail);
+}
+
+/* mem_resize
+ * tries to make the in-use heap chunk p hold units units without moving
+ * it: shrinking splits off the tail, growing absorbs the next physical
+ * chunk when that one is free and large enough.
  *
- * new_bytes must be the number of bytes that are being requested from
- *           the OS with the sbrk command.  It must be an integer 
- *           multiple of the PAGESIZE
+ * returns TRUE if p now has at least units units, FALSE otherwise
+ */
+int mem_resize(mem_heap_t *H, chunk_t *p, int units)
+{
+    chunk_t *next;
+
+    if (p->size < units) {
+        next = NEXT_CHUNK(p);
+        if ((next->flags & CHUNK_INUSE) || p->size + next->size < units)
+            return FALSE;
+        mem_unlink(H, next);
+        p->size += next->size;
+        CLEAR_PREV_FREE(NEXT_CHUNK(p));
+    }
+    mem_trim(H, p, units);
+
+    return TRUE;
+}
+
+/* Mem_realloc
+ * changes the size of the object pointed to by ptr to nbytes and returns a
+ * pointer to it.  The contents are unchanged up to the lesser of the old
+ * and new sizes.  The chunk is resized in place when possible; otherwise
+ * a new chunk is allocated, the data copied and the old chunk freed.  A
+ * NULL ptr behaves like Mem_alloc.
  *
- * returns a pointer to the new memory location.  If the request for
- * new memory fails this function simply returns NULL, and assumes some
- * calling function will handle the error condition.  Since the error
- * condition is catastrophic, nothing can be done but to terminate 
- * the program.
+ * returns NULL if the request cannot be satisfied, leaving ptr untouched
  */
-chunk_t *morecore(int new_bytes) 
+void *Mem_realloc(void *ptr, const int nbytes)
 {
-    char *cp;
-    chunk_t *new_test1;
+    chunk_t *p;
+    void *new_ptr;
+    int units, inPlace;
+    long oldBytes;
 
-    assert(new_bytes % PAGESIZE == 0 && new_bytes > 0);
-    assert(PAGESIZE % sizeof(chunk_t) == 0);
-    cp = sbrk(new_bytes);
-    if (cp == (char *) -1)
+    if (ptr == NULL)
+        return Mem_alloc(nbytes);
+    assert(nbytes > 0);
+
+    p = (chunk_t *) ptr - 1;
+    assert(OWNER_FLAGS(p) & CHUNK_INUSE);
+    units = REQUEST_UNITS(nbytes);
+
+    mem_lock(&DefaultHeap);
+    if (p->flags & CHUNK_MMAPPED)
+        inPlace = (p->size >= units);
+    else
+        inPlace = mem_resize(&DefaultHeap, p, units);
+    if (inPlace == TRUE) {
+        DefaultHeap.num_realloc_in_place++;
+        if (p->flags & CHUNK_SAMPLED)
+            mem_resample(p, nbytes);
+    } else
+        DefaultHeap.num_realloc_copied++;
+    mem_unlock(&DefaultHeap);
+
+    if (inPlace == TRUE) {
+        if (TraceFile != NULL) {
+            mem_trace(ptr, 0);
+            mem_trace(ptr, nbytes);
+        }
+        return ptr;
+    }
+
+    new_ptr = Mem_alloc(nbytes);
+    if (new_ptr == NULL)
         return NULL;
-    new_test1 = (chunk_t *) cp;
-    NumSbrkCalls++; 
-    NumPages += (new_bytes / PAGESIZE);
-    
-    return new_test1;
+    oldBytes = (long) (p->size - 1) * sizeof(chunk_t);
+    memcpy(new_ptr, ptr, oldBytes < nbytes ? oldBytes : nbytes);
+    Mem_free(ptr);
+
+    return new_ptr;
 }
 
-/* Mem_free
- * deallocates the space pointed to by return_ptr; it does nothing if
- * return_ptr is NULL.  
+/* mem_arena_block
+ * takes a chunk with at least nbytes of payload from the default heap for
+ * an arena or a slab
  *
- * This function assumes that the Rover pointer has already been 
- * initialized and points to some memory block in the free list.
+ * returns the chunk, or NULL if the heap cannot grow
  */
-void Mem_free(void *return_ptr)
+chunk_t *mem_arena_block(int nbytes)
 {
-    assert(Rover != NULL && Rover->next != NULL);
-  
-    if (return_ptr != NULL) {
-        chunk_t *marker = NULL, *prevNode = NULL;
-        chunk_t *dumChunk = return_ptr-sizeof(chunk_t);
-        prevNode = Rover;
-        Rover = Rover->next;
-        marker = Rover;
-        
-        do { 
-            if ((prevNode < dumChunk && Rover > dumChunk) || 
-            (prevNode < dumChunk && Rover == &Dummy)) {
-                prevNode->next = dumChunk;
-                dumChunk->next = Rover;
-                break;
-            }
-            prevNode = Rover;
-            Rover = Rover->next;
-        } while(Rover != marker);
-        
-        if (Coalescing == TRUE) {
-            if (dumChunk + dumChunk->size == Rover) {
-                dumChunk->next = Rover->next;
-                Rover->next = NULL;
-                dumChunk->size = dumChunk->size + Rover->size;
-                Rover = dumChunk->next;
-            }
-            if (prevNode+prevNode->size == dumChunk) {
-                prevNode->next = Rover;
-                dumChunk->next = NULL;
-                prevNode->size = prevNode->size + dumChunk->size;
-            }
+    chunk_t *p;
+
+    mem_lock(&DefaultHeap);
+    p = mem_alloc_chunk(&DefaultHeap, REQUEST_UNITS(nbytes + BLOCK_LINK_BYTES));
+    mem_unlock(&DefaultHeap);
+    if (p != NULL)
+        LINK(p) = NULL;
+    return p;
+}
+
+/* Mem_arena_create
+ * makes an arena with one block; the arena header is the first object in
+ * that block.
+ *
+ * returns the arena, or NULL if the heap cannot supply a block
+ */
+mem_arena_t *Mem_arena_create(void)
+{
+    mem_arena_t *A;
+    chunk_t *p;
+
+    p = mem_arena_block(ARENA_BLOCK);
+    if (p == NULL)
+        return NULL;
+
+    A = (mem_arena_t *) BLOCK_DATA(p);
+    A->first = p;
+    A->num_blocks = 1;
+    Mem_arena_reset(A);
+    return A;
+}
+
+/* Mem_arena_alloc
+ * bump-allocates nbytes from the current block.  When the block is full
+ * the next kept block is used if it is large enough; otherwise a new block
+ * (larger than the default for a large object) is taken from the heap and
+ * linked after the current one.
+ *
+ * returns the object, or NULL if the heap cannot supply a block
+ */
+void *Mem_arena_alloc(mem_arena_t *A, const int nbytes)
+{
+    long bytes = ARENA_ROUND(nbytes);
+    chunk_t *next;
+    char *ptr;
+
+    assert(A != NULL && nbytes > 0);
+    if (A->limit - A->avail < bytes) {
+        next = LINK(A->current);
+        if (next == NULL || (char *) (next + next->size) - BLOCK_DATA(next) < bytes) {
+            next = mem_arena_block(bytes > ARENA_BLOCK ? bytes : ARENA_BLOCK);
+            if (next == NULL)
+                return NULL;
+            LINK(next) = LINK(A->current);
+            LINK(A->current) = next;
+            A->num_blocks++;
         }
+        A->current = next;
+        A->avail = BLOCK_DATA(next);
+        A->limit = (char *) (next + next->size);
     }
-} 
 
-/* Mem_alloc
- * returns a pointer to space for an object of size nbytes, or NULL if the
- * request cannot be satisfied.  The memory is uninitialized.
+    ptr = A->avail;
+    A->avail += bytes;
+    A->num_bytes += bytes;
+    return ptr;
+}
+
+/* Mem_arena_reset
+ * frees every object in A by rewinding to the start of the first block
+ */
+void Mem_arena_reset(mem_arena_t *A)
+{
+    assert(A != NULL);
+    A->current = A->first;
+    A->avail = BLOCK_DATA(A->first) + ARENA_ROUND(sizeof(mem_arena_t));
+    A->limit = (char *) (A->first + A->first->size);
+    A->num_bytes = 0;
+}
+
+/* Mem_arena_destroy
+ * returns every block of A to the heap in O(blocks).  The first block goes
+ * last since it holds the arena header.
+ */
+void Mem_arena_destroy(mem_arena_t *A)
+{
+    chunk_t *p, *next, *first;
+
+    if (A == NULL)
+        return;
+    first = A->first;
+    mem_lock(&DefaultHeap);
+    for (p = LINK(first); p != NULL; p = next) {
+        next = LINK(p);
+        mem_release(&DefaultHeap, p);
+    }
+    mem_release(&DefaultHeap, first);
+    mem_unlock(&DefaultHeap);
+}
+
+/* Mem_slab_create
+ * makes an empty slab for slots of slot_bytes bytes, rounded up to a
+ * multiple of the pointer size so every slot can hold the free-list link
+ * and stays aligned.
  *
- * This function assumes that there is a Rover pointer that points to
- * some item in the free list.  By default, Rover is initialized to the
- * address of the dummy block whose size is one, but set the size field
- * to zero so this block can never be removed from the list.  Rover can
- * never be null.
+ * returns the slab, or NULL if the heap cannot supply its header
  */
-void *Mem_alloc(const int nbytes)
+mem_slab_t *Mem_slab_create(const int slot_bytes)
 {
-    assert(nbytes > 0);
-    assert(Rover != NULL && Rover->next != NULL);
+    mem_slab_t *S;
+    int bytes;
+
+    assert(slot_bytes > 0);
+    S = (mem_slab_t *) Mem_alloc(sizeof(mem_slab_t));
+    if (S == NULL)
+        return NULL;
+
+    bytes = (slot_bytes + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    S->slot_bytes = bytes;
+    if (bytes * SLAB_MIN > SLAB_BLOCK)
+        S->slots_per_block = SLAB_MIN;
+    else
+        S->slots_per_block = SLAB_BLOCK / bytes;
+    S->free_slots = NULL;
+    S->blocks = NULL;
+    S->num_blocks = 0;
+    S->num_live = 0;
+    return S;
+}
 
-    int pageCount = 0, unitNum = 0, space = 0;
+/* mem_slab_grow
+ * takes one more block from the heap and threads all of its slots onto
+ * the free list of S
+ *
+ * returns TRUE, or FALSE if the heap cannot grow
+ */
+int mem_slab_grow(mem_slab_t *S)
+{
+    chunk_t *block;
+    char *slot;
+    int i;
 
-    chunk_t *marker, *next, *prev, *bestFit, *test1, *test2;
+    block = mem_arena_block(S->slot_bytes * S->slots_per_block);
+    if (block == NULL)
+        return FALSE;
+    LINK(block) = S->blocks;
+    S->blocks = block;
+    S->num_blocks++;
 
-    //Determine unitNum and pageCount
-    if (nbytes < PAGESIZE) {
-        pageCount = 1;
+    slot = BLOCK_DATA(block);
+    for (i = 0; i < S->slots_per_block; i++) {
+        *(void **) slot = S->free_slots;
+        S->free_slots = slot;
+        slot += S->slot_bytes;
     }
-    else if (nbytes % PAGESIZE != 0) {      //nbytes > PAGESIZE
-        pageCount = (nbytes / PAGESIZE) + 1;    //if nbytes is not a mult of PAGESIZE, extra page
+    return TRUE;
+}
+
+/* Mem_slab_alloc
+ * pops a slot off the free list of S, adding a block first if it is empty
+ *
+ * returns the slot, or NULL if the heap cannot grow
+ */
+void *Mem_slab_alloc(mem_slab_t *S)
+{
+    void *slot;
+
+    assert(S != NULL);
+    if (S->free_slots == NULL && mem_slab_grow(S) == FALSE)
+        return NULL;
+
+    slot = S->free_slots;
+    S->free_slots = *(void **) slot;
+    S->num_live++;
+    return slot;
+}
+
+/* Mem_slab_free
+ * pushes slot ptr back on the free list of S
+ */
+void Mem_slab_free(mem_slab_t *S, void *ptr)
+{
+    assert(S != NULL);
+    if (ptr == NULL)
+        return;
+    *(void **) ptr = S->free_slots;
+    S->free_slots = ptr;
+    S->num_live--;
+}
+
+/* Mem_slab_destroy
+ * returns every block of S to the heap in O(blocks), then S itself
+ */
+void Mem_slab_destroy(mem_slab_t *S)
+{
+    chunk_t *p, *next;
+
+    if (S == NULL)
+        return;
+    mem_lock(&DefaultHeap);
+    for (p = S->blocks; p != NULL; p = next) {
+        next = LINK(p);
+        mem_release(&DefaultHeap, p);
     }
-    else {
-        pageCount = nbytes / PAGESIZE;
+    mem_unlock(&DefaultHeap);
+    Mem_free(S);
+}
+
+/* mem_elapsed_ns
+ * RETURNS the nanoseconds from from to to
+ */
+long mem_elapsed_ns(struct timespec *from, struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+/* mem_trace
+ * appends one record to the trace: an allocation of nbytes at ptr, or a
+ * free of ptr when nbytes is 0.  A free is recorded before the chunk is
+ * released and an allocation after it is made, so a reused address
+ * always appears in the right order.
+ */
+void mem_trace(void *ptr, int nbytes)
+{
+    struct timespec now;
+    long delta;
+
+    if (ThreadSafe == TRUE)
+        pthread_mutex_lock(&TraceLock);
+    if (TraceFile != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        delta = mem_elapsed_ns(&TraceLast, &now);
+        TraceLast = now;
+        TraceBuf[TraceCount].ptr = (uintptr_t) ptr;
+        TraceBuf[TraceCount].delta_ns = delta > UINT32_MAX ? UINT32_MAX : delta;
+        TraceBuf[TraceCount].size = nbytes;
+        if (++TraceCount == TRACE_BUFFER) {
+            fwrite(TraceBuf, sizeof(mem_trace_rec_t), TraceCount, TraceFile);
+            TraceCount = 0;
+        }
     }
+    if (ThreadSafe == TRUE)
+        pthread_mutex_unlock(&TraceLock);
+}
 
-    if (nbytes % sizeof(chunk_t) != 0) {       //if nbytes is not evenly div. by sizeof(chunk_t)
-        unitNum = (nbytes/sizeof(chunk_t))+1;    //   provide number of chunk_t's + 1
+/* Mem_trace_start
+ * starts recording Mem_alloc, Mem_alloc_aligned, Mem_free and Mem_realloc
+ * calls on the default heap to the file path, replacing its contents.
+ *
+ * returns TRUE, or FALSE if the file cannot be opened
+ */
+int Mem_trace_start(const char *path)
+{
+    FILE *fp;
+
+    Mem_trace_stop();
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        return FALSE;
+    fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), fp);
+
+    if (ThreadSafe == TRUE)
+        pthread_mutex_lock(&TraceLock);
+    TraceCount = 0;
+    clock_gettime(CLOCK_MONOTONIC, &TraceLast);
+    TraceFile = fp;
+    if (ThreadSafe == TRUE)
+        pthread_mutex_unlock(&TraceLock);
+    return TRUE;
+}
+
+/* Mem_trace_stop
+ * writes the buffered records and closes the trace file, if one is open
+ */
+void Mem_trace_stop(void)
+{
+    FILE *fp;
+
+    if (ThreadSafe == TRUE)
+        pthread_mutex_lock(&TraceLock);
+    fp = TraceFile;
+    TraceFile = NULL;
+    if (fp != NULL && TraceCount > 0)
+        fwrite(TraceBuf, sizeof(mem_trace_rec_t), TraceCount, fp);
+    TraceCount = 0;
+    if (ThreadSafe == TRUE)
+        pthread_mutex_unlock(&TraceLock);
+    if (fp != NULL)
+        fclose(fp);
+}
+
+/* mem_cmp_long
+ * qsort comparison for longs
+ */
+int mem_cmp_long(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* mem_replay
+ * replays the trace in path against heap H and fills in R.  When
+ * timeAllocs is TRUE every allocation is timed on its own and R gets the
+ * tail latencies; the clock reads then dominate ns_per_op.
+ *
+ * The records are first read and every free is matched with the
+ * allocation it undoes through an open-addressing table keyed by address,
+ * so the timed loop only indexes an array.  Frees of objects allocated
+ * before the trace started are skipped.  The scratch arrays are mapped
+ * directly, so the replay disturbs no heap but H.
+ *
+ * returns TRUE, or FALSE if the file is not a trace or scratch space
+ * cannot be mapped
+ */
+int mem_replay(const char *path, mem_heap_t *H, mem_replay_t *R, int timeAllocs)
+{
+    FILE *fp;
+    char magic[sizeof(TRACE_MAGIC)];
+    mem_trace_rec_t *recs;
+    uint64_t *keys;
+    long *slots, *vals, *lat, n, i, j, k, cap, h, live, numAllocs, scratch;
+    void **objs;
+    int pages, sbrks, mmaps;
+    struct timespec start, stop, t0, t1;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        return FALSE;
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+            || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        fclose(fp);
+        return FALSE;
     }
-    else {
-        unitNum = nbytes/sizeof(chunk_t);        //if nbytes is evenly divis. by sizeof(chunk_t)
-    }                                          //   return quotient
+    fseek(fp, 0, SEEK_END);
+    n = (ftell(fp) - (long) sizeof(magic)) / sizeof(mem_trace_rec_t);
+    fseek(fp, sizeof(magic), SEEK_SET);
 
-    if (Dummy.next == &Dummy) {                //if list is empty
-        Rover = morecore(pageCount * PAGESIZE);    //then move rover to new memory block
-        
-        if (Rover == NULL)
-            return NULL;
-            
-        Dummy.next = Rover;
-        Rover->size = unitNum + 1;
-        
-        //check if user wants exactly one page
-        if (((pageCount * PAGESIZE) / sizeof(chunk_t)) - (unitNum + 1) == 0) {
-            Rover->next = NULL;
-            return (Rover + 1);
-        }
-        
-        Rover += unitNum + 1;         //add to rover unitNum including header
-        Rover->next = &Dummy;
-        Rover->size = ((pageCount * PAGESIZE) / sizeof(chunk_t)) - (unitNum + 1);
-        Dummy.next = Rover;
-        (Rover - unitNum - 1)->next = NULL;
-        test1 = Rover - unitNum - 1;
-        test2 = Rover - unitNum;
-        
-        //assertion checks
-        assert(test1 + 1 == test2);  
-        assert((test1->size - 1)*sizeof(chunk_t) >= nbytes);
-        assert((test1->size - 1)*sizeof(chunk_t) <= nbytes + sizeof(chunk_t));
-        assert(test1->next == NULL);
-
-        return Rover - unitNum;
-    }
-    else if (SearchPolicy == FIRST_FIT) {       //list is not empty & search policy is first fit
-        marker = Rover;                           //  marker at current rover
-        do {
-            if (Rover->size == unitNum + 1) {     //if block has exact space
-                marker = Rover;
-                Rover = Rover->next;
-                prev = &Dummy;
-
-                while (prev->next != marker)    //find prevNode memory block
-                    prev = prev->next;
-
-                prev->next = Rover;
-                marker->next = NULL;
-
-                test1 = marker;
-                test2 = marker + 1;
-
-                //assertion checks
-                assert(test1 + 1 == test2);
-                assert((test1->size - 1)*sizeof(chunk_t) >= nbytes);
-                assert((test1->size - 1)*sizeof(chunk_t) <= nbytes + sizeof(chunk_t));
-                assert(test1->next == NULL);
-
-                return (marker + 1);
-            }
-            else if (Rover->size > unitNum + 1) {     //if block has more than enough space
-                marker = Rover;
-                long remainder = Rover->size;
-                next = Rover + unitNum + 1;
-                Rover->size = unitNum + 1;
-                prev = &Dummy;
-                
-                while (prev->next != marker)      //find prev block of mem
-                    prev = prev->next;
-
-                prev->next = next;    
-                Rover += unitNum + 1;
-                Rover->next = marker->next;
-                Rover->size = remainder - (unitNum + 1);
-                (Rover - unitNum - 1)->next = NULL;
-
-                test1 = Rover - unitNum - 1;
-                test2 = Rover - unitNum;
-
-                //assertion checks
-                assert(test1 + 1 == test2);  
-                assert((test1->size - 1) * sizeof(chunk_t) >= nbytes);
-                assert((test1->size - 1) * sizeof(chunk_t) <= nbytes + sizeof(chunk_t));
-                assert(test1->next == NULL);
-
-                return (Rover - unitNum);
+    // a table at most half full, so a probe always ends
+    for (cap = 16; cap < 2 * n; cap *= 2)
+        ;
+    scratch = n * (sizeof(mem_trace_rec_t) + 2 * sizeof(long) + sizeof(void *))
+            + cap * (sizeof(uint64_t) + sizeof(long));
+    recs = mmap(NULL, scratch, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (recs == MAP_FAILED) {
+        fclose(fp);
+        return FALSE;
+    }
+    slots = (long *) (recs + n);
+    objs = (void **) (slots + n);
+    keys = (uint64_t *) (objs + n);
+    vals = (long *) (keys + cap);
+    lat = vals + cap;
+    n = fread(recs, sizeof(mem_trace_rec_t), n, fp);
+    fclose(fp);
+
+    // give every allocation a slot and point its free at the same slot;
+    // key 1 marks a deleted table entry
+    numAllocs = live = 0;
+    R->peak_live_bytes = 0;
+    for (i = 0; i < n; i++) {
+        h = (recs[i].ptr >> 4) * 0x9E3779B97F4A7C15ULL & (cap - 1);
+        if (recs[i].size > 0) {
+            while (keys[h] > 1 && keys[h] != recs[i].ptr)
+                h = (h + 1) & (cap - 1);
+            keys[h] = recs[i].ptr;
+            vals[h] = i;
+            slots[i] = numAllocs++;
+            live += recs[i].size;
+            if (live > R->peak_live_bytes)
+                R->peak_live_bytes = live;
+        } else {
+            slots[i] = -1;
+            while (keys[h] != 0 && keys[h] != recs[i].ptr)
+                h = (h + 1) & (cap - 1);
+            if (keys[h] != 0) {
+                j = vals[h];
+                keys[h] = 1;
+                slots[i] = slots[j];
+                live -= recs[j].size;
             }
+        }
+    }
+
+    mem_lock(H);
+    pages = H->num_pages;
+    sbrks = H->num_sbrk_calls;
+    mmaps = H->num_mmap_calls;
+    mem_unlock(H);
+
+    R->num_ops = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n; i++) {
+        k = slots[i];
+        if (k < 0)
+            continue;
+        if (recs[i].size > 0 && timeAllocs == TRUE) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            objs[k] = Mem_heap_alloc(H, recs[i].size);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            lat[k] = mem_elapsed_ns(&t0, &t1);
+        } else if (recs[i].size > 0) {
+            objs[k] = Mem_heap_alloc(H, recs[i].size);
+        } else {
+            Mem_heap_free(H, objs[k]);
+            objs[k] = NULL;
+        }
+        R->num_ops++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    mem_lock(H);
+    R->peak_pages = H->num_pages - pages;
+    R->num_sbrk_calls = H->num_sbrk_calls - sbrks;
+    R->num_mmap_calls = H->num_mmap_calls - mmaps;
+    mem_unlock(H);
+    R->ns_per_op = R->num_ops > 0 ? (double) mem_elapsed_ns(&start, &stop) / R->num_ops : 0.0;
+    R->fragmentation = 0.0;
+    if (R->peak_pages > 0)
+        R->fragmentation = 1.0 - (double) R->peak_live_bytes / ((long) R->peak_pages * PAGESIZE);
+    R->p99_alloc_ns = R->p999_alloc_ns = R->max_alloc_ns = 0;
+    if (timeAllocs == TRUE && numAllocs > 0) {
+        qsort(lat, numAllocs, sizeof(long), mem_cmp_long);
+        R->p99_alloc_ns = lat[numAllocs * 99 / 100];
+        R->p999_alloc_ns = lat[numAllocs * 999 / 1000];
+        R->max_alloc_ns = lat[numAllocs - 1];
+    }
+
+    // objects the trace never freed
+    for (k = 0; k < numAllocs; k++)
+        Mem_heap_free(H, objs[k]);
+    munmap(recs, scratch);
+    return TRUE;
+}
+
+/* Mem_trace_replay
+ * replays the trace in path against heap H and fills in R, leaving the
+ * latency fields 0
+ */
+int Mem_trace_replay(const char *path, mem_heap_t *H, mem_replay_t *R)
+{
+    return mem_replay(path, H, R, FALSE);
+}
+
+/* Mem_trace_latency
+ * replays the trace in path against heap H, timing every allocation, and
+ * fills in R including its latency fields
+ */
+int Mem_trace_latency(const char *path, mem_heap_t *H, mem_replay_t *R)
+{
+    return mem_replay(path, H, R, TRUE);
+}
 
-            Rover = Rover->next;
+/* Mem_trace_report
+ * replays the trace in path for every search policy, with and without
+ * coalescing, and prints one line of results for each.  Throughput and
+ * latency come from two replays, each against a fresh heap, so the clock
+ * reads around every allocation do not show up in ns/op.  The heaps are
+ * destroyed after each line.
+ */
+void Mem_trace_report(const char *path)
+{
+    int policies[] = {FIRST_FIT, BEST_FIT, SEGREGATED_FIT, TLSF_FIT};
+    char *names[] = {"first fit", "best fit", "segregated fit", "tlsf"};
+    int i, coalescing, replayed;
+    mem_heap_t *H, *L;
+    mem_replay_t R, T;
 
-        } while (Rover != marker);
+    printf("\n%-15s %-10s %10s %10s %8s %8s %8s %8s %8s %8s\n", "policy",
+            "coalescing", "ops", "ns/op", "pages", "sbrk", "frag", "p99", "p999", "max");
+    for (i = 0; i < (int) (sizeof(policies) / sizeof(policies[0])); i++) {
+        for (coalescing = TRUE; coalescing >= FALSE; coalescing--) {
+            H = Mem_heap_create(policies[i], coalescing);
+            L = Mem_heap_create(policies[i], coalescing);
+            replayed = H != NULL && L != NULL && Mem_trace_replay(path, H, &R) == TRUE
+                    && Mem_trace_latency(path, L, &T) == TRUE;
+            Mem_heap_destroy(H);
+            Mem_heap_destroy(L);
+            if (replayed == FALSE) {
+                printf("%-15s cannot replay %s\n", names[i], path);
+                return;
+            }
+            printf("%-15s %-10s %10ld %10.1f %8d %8d %7.1f%% %8ld %8ld %8ld\n",
+                    names[i], coalescing ? "yes" : "no", R.num_ops, R.ns_per_op,
+                    R.peak_pages, R.num_sbrk_calls, 100.0 * R.fragmentation,
+                    T.p99_alloc_ns, T.p999_alloc_ns, T.max_alloc_ns);
+        }
     }
-    else if (SearchPolicy == BEST_FIT) {
-        marker = Rover;
-        do {
-            if (Rover->size == unitNum + 1) { //if exact space needed
-                marker = Rover;
-                Rover = Rover->next;
-                prev = &Dummy;
+}
+
+/* mem_sample_interval
+ * RETURNS the bytes to allocate before the next sample, drawn from an
+ * exponential distribution with mean ProfileBytes so that every byte is
+ * equally likely to be sampled
+ */
+long mem_sample_interval(void)
+{
+    double u = (rand_r(&SampleSeed) + 1.0) / (RAND_MAX + 2.0);
+
+    return (long) (-log(u) * ProfileBytes) + 1;
+}
 
-                while (prev->next != marker)   //find prev mem block
-                    prev = prev->next;
+/* mem_sample
+ * records the allocation of nbytes at ptr, which ran the thread's
+ * countdown out, with the call stack that made it.  The first call on a
+ * thread only starts the countdown.  The stack starts inside Mem_alloc or
+ * Mem_alloc_aligned.
+ */
+void mem_sample(void *ptr, int nbytes)
+{
+    void *frames[PROFILE_DEPTH + 1];
+    uint64_t hash = 14695981039346656037ULL;
+    mem_stack_t *st = NULL;
+    chunk_t *p = (chunk_t *) ptr - 1;
+    int depth, i, k;
 
-                prev->next = Rover; //set prevNode next to rover
-                marker->next = NULL;
+    if (SampleSeed == 0) {
+        SampleSeed = (unsigned int) (uintptr_t) &SampleSeed | 1;
+        SampleCountdown = mem_sample_interval();
+        return;
+    }
+    SampleCountdown = mem_sample_interval();
 
-                test1 = marker;
-                test2 = marker + 1;
-                
-                //assertion checks
-                assert(test1 + 1 == test2); 
-                assert((test1->size - 1)*sizeof(chunk_t) >= nbytes);
-                assert((test1->size - 1)*sizeof(chunk_t) <= nbytes + sizeof(chunk_t));
-                assert(test1->next == NULL);
+    //unwinding is slow, so it happens before the lock; frame 0 is here
+    depth = backtrace(frames, PROFILE_DEPTH + 1) - 1;
+    for (i = 1; i <= depth; i++)
+        hash = (hash ^ (uintptr_t) frames[i]) * 1099511628211ULL;
+    hash |= 1;
 
-                return (marker + 1);
+    mem_lock(&DefaultHeap);
+    if (Stacks == NULL) {
+        Stacks = mmap(NULL, PROFILE_STACKS * sizeof(mem_stack_t) + PROFILE_LIVE * sizeof(mem_sample_t),
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (Stacks == MAP_FAILED)
+            Stacks = NULL;
+        else
+            Live = (mem_sample_t *) (Stacks + PROFILE_STACKS);
+    }
+    if (Stacks != NULL && NumLive < PROFILE_LIVE / 4 * 3) {
+        for (k = hash & (PROFILE_STACKS - 1); ; k = (k + 1) & (PROFILE_STACKS - 1)) {
+            st = &Stacks[k];
+            if (st->hash == hash && st->depth == depth
+                    && memcmp(st->frames, frames + 1, depth * sizeof(void *)) == 0)
+                break;
+            if (st->hash == 0 && NumStacks < PROFILE_STACKS / 4 * 3) {
+                st->hash = hash;
+                st->depth = depth;
+                memcpy(st->frames, frames + 1, depth * sizeof(void *));
+                NumStacks++;
+                break;
             }
-            else if (Rover->size > unitNum + 1) { //if not exact space, find best fit
-                marker = Rover;
-                bestFit = Rover;
-                space = bestFit->size - (unitNum + 1);
-                prev = &Dummy;
-
-                while (prev->next != marker) {
-                    prev = prev->next;
-                    if ((prev->size - (unitNum + 1)) < space) {
-                        bestFit = prev;
-                        space = bestFit->size - (unitNum + 1);
-                    }
-                }
-
-                next = bestFit->next;
-
-                while (prev->next != bestFit)      //find prev mem block
-                    prev = prev->next;
-
-                bestFit += unitNum + 1;
-                prev->next = bestFit;
-                bestFit->next = next;
-                bestFit->size = space;
-                (bestFit - unitNum - 1)->size = unitNum + 1;
-                (bestFit - unitNum - 1)->next = NULL;
-                                
-                test1 = bestFit - unitNum - 1;
-                test2 = bestFit - unitNum;
-
-                //assertion checks
-                assert(test1 + 1 == test2);   
-                assert((test1->size - 1) * sizeof(chunk_t) >= nbytes);
-                assert((test1->size - 1) * sizeof(chunk_t) <= nbytes + sizeof(chunk_t));
-                assert(test1->next == NULL);
-
-                Rover = bestFit->next;
-                return bestFit - unitNum;
+            if (st->hash == 0) {
+                st = NULL;
+                break;
             }
+        }
+    }
+    if (st != NULL) {
+        st->inuse_objs++;
+        st->inuse_bytes += nbytes;
+        st->alloc_objs++;
+        st->alloc_bytes += nbytes;
+        i = ((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL & (PROFILE_LIVE - 1);
+        while (Live[i].ptr != 0)
+            i = (i + 1) & (PROFILE_LIVE - 1);
+        Live[i].ptr = (uintptr_t) ptr;
+        Live[i].stack = st - Stacks;
+        Live[i].size = nbytes;
+        NumLive++;
+        //neighbours update this header under the same lock
+        p->flags |= CHUNK_SAMPLED;
+    } else {
+        NumDropped++;
+    }
+    mem_unlock(&DefaultHeap);
+}
 
-            Rover = Rover->next;
+/* mem_unsample
+ * forgets the sample of chunk p, which is being freed.  Later entries of
+ * its probe run are shifted back into the hole, so lookups never meet a
+ * deleted entry.  The caller holds the lock of the default heap.
+ */
+void mem_unsample(chunk_t *p)
+{
+    uintptr_t ptr = (uintptr_t) (p + 1);
+    int i, j, home;
 
-        } while (Rover != marker);
+    p->flags &= ~CHUNK_SAMPLED;
+    i = (ptr >> 4) * 0x9E3779B97F4A7C15ULL & (PROFILE_LIVE - 1);
+    while (Live[i].ptr != ptr) {
+        assert(Live[i].ptr != 0);
+        i = (i + 1) & (PROFILE_LIVE - 1);
     }
+    Stacks[Live[i].stack].inuse_objs--;
+    Stacks[Live[i].stack].inuse_bytes -= Live[i].size;
+    NumLive--;
 
-        next = Rover->next;
-        prev = &Dummy;
+    for (j = (i + 1) & (PROFILE_LIVE - 1); Live[j].ptr != 0; j = (j + 1) & (PROFILE_LIVE - 1)) {
+        home = (Live[j].ptr >> 4) * 0x9E3779B97F4A7C15ULL & (PROFILE_LIVE - 1);
+        //j may move back to i unless its home lies in (i, j]
+        if (((j - home) & (PROFILE_LIVE - 1)) >= ((j - i) & (PROFILE_LIVE - 1))) {
+            Live[i] = Live[j];
+            i = j;
+        }
+    }
+    Live[i].ptr = 0;
+}
 
-        while (prev->next != Rover)   //find prev mem block
-            prev = prev->next;
+/* mem_resample
+ * moves the sample of chunk p, which was resized in place, to its new
+ * size of nbytes.  The caller holds the lock of the default heap.
+ */
+void mem_resample(chunk_t *p, int nbytes)
+{
+    uintptr_t ptr = (uintptr_t) (p + 1);
+    int i;
 
-        Rover = morecore(pageCount * PAGESIZE);
+    i = (ptr >> 4) * 0x9E3779B97F4A7C15ULL & (PROFILE_LIVE - 1);
+    while (Live[i].ptr != ptr) {
+        assert(Live[i].ptr != 0);
+        i = (i + 1) & (PROFILE_LIVE - 1);
+    }
+    Stacks[Live[i].stack].inuse_bytes += nbytes - Live[i].size;
+    Live[i].size = nbytes;
+}
 
-        if (Rover == NULL)
-            return NULL;
+/* Mem_profile_dump
+ * writes every call stack the heap profiler has sampled to the file path
+ * in the legacy text heap profile format read by pprof: live samples and
+ * all samples with their requested bytes, followed by the memory map used
+ * to symbolize the addresses.  pprof scales the counts by the sampling
+ * rate in the header.
+ *
+ * returns TRUE, or FALSE if the file cannot be opened
+ */
+int Mem_profile_dump(const char *path)
+{
+    FILE *fp, *maps;
+    long objs = 0, bytes = 0, allocObjs = 0, allocBytes = 0;
+    char line[512];
+    mem_stack_t *st;
+    int i, j;
 
-        Rover->size = unitNum + 1;
-        
-        if (((pageCount * PAGESIZE) / sizeof(chunk_t)) - (unitNum + 1) == 0) {
-            chunk_t *test = Rover;
-            Rover = Dummy.next;
-            test->next = NULL;
-            return (test + 1);
-        }
-        
-        chunk_t *lastChunk = Rover;
-        while (lastChunk->next != &Dummy)
-            lastChunk = lastChunk->next;
-        lastChunk->next = Rover;
-            
-        Rover += unitNum + 1;
-        Rover->next = &Dummy;
-        prev->next = Rover;
-        (Rover - unitNum - 1)->next = NULL;
-
-        test1 = Rover - unitNum - 1;
-        test2 = Rover - unitNum;
-
-        assert(test1 + 1 == test2);  
-        assert((test1->size - 1) * sizeof(chunk_t) >= nbytes);
-        assert((test1->size - 1) * sizeof(chunk_t) <= nbytes + sizeof(chunk_t));
-        assert(test1->next == NULL);
-
-        return (Rover - unitNum);
+    fp = fopen(path, "w");
+    if (fp == NULL)
+        return FALSE;
 
-    return NULL;
+    mem_lock(&DefaultHeap);
+    for (i = 0; Stacks != NULL && i < PROFILE_STACKS; i++) {
+        objs += Stacks[i].inuse_objs;
+        bytes += Stacks[i].inuse_bytes;
+        allocObjs += Stacks[i].alloc_objs;
+        allocBytes += Stacks[i].alloc_bytes;
+    }
+    fprintf(fp, "heap profile: %ld: %ld [%ld: %ld] @ heap_v2/%d\n",
+            objs, bytes, allocObjs, allocBytes, ProfileBytes);
+    for (i = 0; Stacks != NULL && i < PROFILE_STACKS; i++) {
+        st = &Stacks[i];
+        if (st->hash == 0)
+            continue;
+        fprintf(fp, "%ld: %ld [%ld: %ld] @", st->inuse_objs, st->inuse_bytes,
+                st->alloc_objs, st->alloc_bytes);
+        for (j = 0; j < st->depth; j++)
+            fprintf(fp, " 0x%lx", (unsigned long) (uintptr_t) st->frames[j]);
+        fprintf(fp, "\n");
+    }
+    if (NumDropped > 0)
+        fprintf(stderr, "Mem_profile_dump: %ld samples dropped, tables full\n", NumDropped);
+    mem_unlock(&DefaultHeap);
+
+    fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+    maps = fopen("/proc/self/maps", "r");
+    if (maps != NULL) {
+        while (fgets(line, sizeof(line), maps) != NULL)
+            fputs(line, fp);
+        fclose(maps);
+    }
+    fclose(fp);
+    return TRUE;
 }
 
-/* Mem_stats
- * prints stats about the current free list
+/* Mem_heap_stats
+ * prints stats about the current free list of heap H
  *
  * -- number of items in the linked list including dummy item
  * -- min, max, and average size of each item (in bytes)
@@ -343,67 +2456,178 @@ void *Mem_alloc(const int nbytes)
  *
  * A message is printed if all the memory is in the free list
  */
-void Mem_stats(void)
+void Mem_heap_stats(mem_heap_t *H)
 {
     // One of the stats you must collect is the total number
     // of pages that have been requested using sbrk.
     // Say, you call this NumPages.  You also must count M,
-    // the total number of bytes found in the free list 
+    // the total number of bytes found in the free list
     // (including all bytes used for headers).  If it is the case
     // that M == NumPages * PAGESiZE then print
-    
+
     //get the total number of unitNum in the list
-    
-    printf("\nTotal Number of Pages = %d\n", NumPages);
-    printf("SBRK was called a total of %d times.\n", NumSbrkCalls);
-    
-    chunk_t *dumChunk = &Dummy;
-    dumChunk = dumChunk->next;
+
+    mem_lock(H);
+    mem_remote_drain(H);
+    printf("\nTotal Number of Pages = %d\n", H->num_pages);
+    printf("SBRK was called a total of %d times.\n", H->num_sbrk_calls);
+    printf("MMAP was called a total of %d times.\n", H->num_mmap_calls);
+    printf("Large chunks in their own mapping = %d (%ld bytes)\n",
+            H->num_mappings, H->mmapped_bytes);
+    printf("Mem_realloc resized in place %d times and copied %d times.\n",
+            H->num_realloc_in_place, H->num_realloc_copied);
+    printf("Chunks freed by other threads = %ld\n", H->num_remote_frees);
+
+    chunk_t *dumChunk = H->dummy;
+    dumChunk = LINK(dumChunk);
     long min = 999999999, max = 0;
     long M = 0, avg = 0;
     int numItems = 1;
-    min = dumChunk->size;
-    max = dumChunk->size;
-    while(dumChunk != &Dummy) {
+    while(dumChunk != H->dummy) {
         if (dumChunk->size >= max) {        //max
             max = dumChunk->size;
         }
-        if (dumChunk->size <= min && dumChunk->size != 0) {   //min
+        if (dumChunk->size <= min) {        //min
             min = dumChunk->size;
         }
         avg += dumChunk->size;                              //avg
         M += (dumChunk->size * sizeof(chunk_t));
-        dumChunk = dumChunk->next;
+        dumChunk = LINK(dumChunk);
         numItems++;                                         //increment count
     }
-    
+
+    //chunks filed in the segregated-fit bins and TLSF lists are free
+    //memory too
+    int numBinned = 0, i;
+    chunk_t *head;
+    for (i = 0; H->bins_ready == TRUE && i < NUM_LISTS; i++) {
+        head = mem_list_head(H, i);
+        for (dumChunk = LINK(head); dumChunk != head; dumChunk = LINK(dumChunk)) {
+            if (dumChunk->size <= min) {
+                min = dumChunk->size;
+            }
+            if (dumChunk->size >= max) {
+                max = dumChunk->size;
+            }
+            avg += dumChunk->size;
+            M += (dumChunk->size * sizeof(chunk_t));
+            numBinned++;
+        }
+    }
+    numItems += numBinned;
+    if (min > max)
+        min = 0;
+
+    //every region ends with a fencepost that is never free
+    long fenceBytes = 0;
+    for (dumChunk = H->top; dumChunk != NULL; dumChunk = LINK(dumChunk))
+        fenceBytes += FENCE_UNITS * sizeof(chunk_t);
+
     printf("Total number of items in free list = %d\n", numItems);
+    printf("Number of those items held in size-class bins = %d\n", numBinned);
     printf("Min size of chunk in free list = %ld\n", min);
     printf("Max size of chunk in free list = %ld\n", max);
     printf("Average size of chunk in free list = %ld\n", avg/((long)numItems));
     printf("The size of a chunk_t is %lu.\n", sizeof(chunk_t));
-    printf("Total bytes in free list = %ld\n\n", M);
-    if(M == (NumPages * PAGESIZE))   
+    printf("Total bytes in free list = %ld\n", M);
+    printf("Bytes used by region fenceposts = %ld\n", fenceBytes);
+    printf("Bytes held in thread caches = %ld\n",
+            H == &DefaultHeap ? (long) CachedBytes : 0L);
+    printf("Heap bytes retained = %ld, resident = %ld (%ld purged)\n",
+            (long) H->num_pages * PAGESIZE,
+            (long) H->num_pages * PAGESIZE - H->purged_bytes, H->purged_bytes);
+    printf("Heap bytes eligible for huge pages = %ld\n\n", H->huge_bytes);
+    if(M + fenceBytes == ((long)H->num_pages * PAGESIZE))
         printf("all memory is in the heap -- no leaks are possible\n");
+    mem_unlock(H);
+}
+
+/* Mem_stats
+ * prints stats about the free list of the default heap
+ */
+void Mem_stats(void)
+{
+    Mem_heap_stats(&DefaultHeap);
 }
 
 /* Mem_print
- * print table of memory in free list 
+ * print table of memory in the free list of the default heap
  *
- * The print should include the dummy item in the list 
+ * The print should include the dummy item in the list
  */
 void Mem_print(void)
 {
-    assert(Rover != NULL && Rover->next != NULL);
-    chunk_t *start = &Dummy;
+    mem_heap_t *H = &DefaultHeap;
+
+    mem_lock(H);
+    assert(H->rover != NULL && LINK(H->rover) != NULL);
+    chunk_t *start = H->dummy;
     chunk_t *test1 = start;
     do {
         // example format.  Modify for your design
-        printf("p=%p, size=%ld, end=%p, next=%p %s\n", 
-                test1, test1->size, test1 + test1->size, test1->next, test1->size!=0?"":"<-- dummy");
-        test1 = test1->next;
+        printf("p=%p, size=%d, end=%p, next=%p %s\n",
+                test1, test1->size, test1 + test1->size, LINK(test1), test1->size!=0?"":"<-- dummy");
+        test1 = LINK(test1);
     } while (test1 != start);
-    mem_validate();
+
+    int i;
+    chunk_t *head;
+    for (i = 0; H->bins_ready == TRUE && i < NUM_LISTS; i++) {
+        head = mem_list_head(H, i);
+        if (LINK(head) == head)
+            continue;
+        if (i < NUM_BINS)
+            printf("bin %d:", i);
+        else
+            printf("tlsf %d/%d:", (i - NUM_BINS) / TLSF_SL_COUNT, (i - NUM_BINS) % TLSF_SL_COUNT);
+        for (test1 = LINK(head); test1 != head; test1 = LINK(test1))
+            printf(" %p", test1);
+        printf("\n");
+    }
+    mem_validate(H);
+    mem_unlock(H);
+}
+
+/* mem_check_chunk
+ * asserts the boundary tag invariants of a chunk found on a free list
+ */
+void mem_check_chunk(mem_heap_t *H, chunk_t *p)
+{
+    assert(p->size >= MIN_CHUNK);
+    assert(!(p->flags & CHUNK_INUSE));
+    assert(FOOTER(p)->size == p->size);
+    assert(PREV_LINK(LINK(p)) == p);
+    assert(NEXT_CHUNK(p)->flags & CHUNK_PREV_FREE);
+    if (H->coalescing) {
+        // a free chunk never has a free physical neighbour
+        assert(NEXT_CHUNK(p)->flags & CHUNK_INUSE);
+        assert(!(p->flags & CHUNK_PREV_FREE));
+    }
+}
+
+/* mem_tree_check
+ * asserts the ordering and AVL balance of the size subtree of H rooted at
+ * node and adds the number of nodes to count
+ *
+ * RETURNS the height of the subtree
+ */
+int mem_tree_check(mem_heap_t *H, chunk_t *node, int *count)
+{
+    int lh, rh;
+
+    if (node == NULL)
+        return 0;
+    assert(!(node->flags & CHUNK_INUSE) && IN_TREE(H, node->size));
+    if (TREE_LEFT(node) != NULL)
+        assert(mem_tree_cmp(TREE_LEFT(node), node) < 0);
+    if (TREE_RIGHT(node) != NULL)
+        assert(mem_tree_cmp(TREE_RIGHT(node), node) > 0);
+    lh = mem_tree_check(H, TREE_LEFT(node), count);
+    rh = mem_tree_check(H, TREE_RIGHT(node), count);
+    assert(lh - rh >= -1 && lh - rh <= 1);
+    assert(TREE_HEIGHT(node) == 1 + MEM_MAX(lh, rh));
+    *count += 1;
+    return TREE_HEIGHT(node);
 }
 
 /* This is an experimental function to attempt to validate the free
@@ -411,56 +2635,93 @@ void Mem_print(void)
  * will be appropriate for all designs.  If your design utilizes a different
  * approach, that is fine.  You do not need to use this function and you
  * are not required to write your own validate function.
+ *
+ * Checks the boundary tags of every chunk on the free lists, then walks
+ * every region chunk by chunk and checks that the prev-free bits agree
+ * with the chunks they describe and that every free chunk was on a list.
  */
-void mem_validate(void)
+void mem_validate(mem_heap_t *H)
 {
-    assert(Rover != NULL && Rover->next != NULL);
-    assert(Rover->size >= 0);
-    int wrapped = FALSE;
+    assert(H->rover != NULL && LINK(H->rover) != NULL);
+    assert(H->rover->size >= 0);
     int found_dummy = FALSE;
     int found_rover = FALSE;
-    chunk_t *test1, *largest, *smallest;
+    int numListed = 0, numFree = 0, numTree = 0, numIndexed = 0;
+    int i, fl, sl, prevFree;
+    long purged = 0;
+    chunk_t *test1, *end, *head;
 
-    // for validate begin at Dummy
-    test1 = &Dummy;
+    // the size tree must be a valid AVL tree holding exactly the chunks
+    // on the dummy list
+    mem_tree_check(H, H->size_tree, &numTree);
+
+    // for validate begin at the dummy
+    test1 = H->dummy;
     do {
         if (test1->size == 0) {
             assert(found_dummy == FALSE);
             found_dummy = TRUE;
+            assert(PREV_LINK(LINK(test1)) == test1);
         } else {
-            assert(test1->size > 0);
+            mem_check_chunk(H, test1);
+            assert(!IN_BINS(H, test1->size) && !IN_TLSF(H));
+            numListed++;
+            if (IN_TREE(H, test1->size))
+                numIndexed++;
         }
-        if (test1 == Rover) {
+        if (test1 == H->rover) {
             assert(found_rover == FALSE);
             found_rover = TRUE;
         }
-        test1 = test1->next;
-    } while (test1 != &Dummy);
+        test1 = LINK(test1);
+    } while (test1 != H->dummy);
     assert(found_dummy == TRUE);
     assert(found_rover == TRUE);
+    assert(numTree == numIndexed);
 
-    if (Coalescing) {
-        do {
-            if (test1 >= test1->next) {
-                // this is not good unless at the one wrap
-                if (wrapped == TRUE) {
-                    printf("validate: List is out of order, already found wrap\n");
-                    printf("first largest %p, smallest %p\n", largest, smallest);
-                    printf("second largest %p, smallest %p\n", test1, test1->next);
-                    assert(0);   // stop and use gdb
-                } else {
-                    wrapped = TRUE;
-                    largest = test1;
-                    smallest = test1->next;
-                }
+    // every binned chunk must have exactly the size of its bin, every
+    // TLSF chunk must map to its list, and a TLSF list must be marked in
+    // the bitmaps exactly when it is not empty
+    for (i = 0; H->bins_ready == TRUE && i < NUM_LISTS; i++) {
+        head = mem_list_head(H, i);
+        if (i >= NUM_BINS) {
+            fl = (i - NUM_BINS) / TLSF_SL_COUNT;
+            sl = (i - NUM_BINS) % TLSF_SL_COUNT;
+            assert(((H->tlsf_sl[fl] >> sl) & 1) == (LINK(head) != head));
+            assert(((H->tlsf_fl >> fl) & 1) == (H->tlsf_sl[fl] != 0));
+        }
+        for (test1 = LINK(head); test1 != head; test1 = LINK(test1)) {
+            if (i < NUM_BINS) {
+                assert(test1->size == i);
             } else {
-                assert(test1 + test1->size < test1->next);
+                mem_tlsf_index(test1->size, &fl, &sl);
+                assert(head == H->tlsf[fl][sl]);
+            }
+            mem_check_chunk(H, test1);
+            numListed++;
+        }
+    }
+
+    // walk the heap physically, region by region
+    for (end = H->top; end != NULL; end = LINK(end)) {
+        assert(end->flags & CHUNK_FENCE);
+        prevFree = FALSE;
+        for (test1 = REGION_START(end); test1 < end; test1 = NEXT_CHUNK(test1)) {
+            assert(test1->size > 0);
+            assert(((test1->flags & CHUNK_PREV_FREE) != 0) == prevFree);
+            prevFree = !(test1->flags & CHUNK_INUSE);
+            if (prevFree)
+                numFree++;
+            if (test1->flags & CHUNK_PURGED) {
+                assert(prevFree);
+                purged += mem_purgeable(test1, NULL);
             }
-            test1 = test1->next;
-        } while (test1 != &Dummy);
-        assert(wrapped == TRUE);
+        }
+        assert(test1 == end);
+        assert(((end->flags & CHUNK_PREV_FREE) != 0) == prevFree);
     }
+    assert(numFree == numListed);
+    assert(purged == H->purged_bytes);
 }
 
 /* vi:set ts=8 sts=4 sw=4 et: */
-
@@ -4,31 +4,143 @@
 #define PAGESIZE 4096
 #define FIRST_FIT  0x1 
 #define BEST_FIT   0xB
+#define SEGREGATED_FIT 0x5
+#define TLSF_FIT   0x7
 #define TRUE 1
 #define FALSE 0
 
-/* must be FIRST_FIT or BEST_FIT */
-int SearchPolicy;
+/* page sources for morecore */
+#define SBRK_SOURCE 0
+#define MMAP_SOURCE 1
 
-/* TRUE if memory returned to free list is coalesced */
-int Coalescing;
+/* must be FIRST_FIT, BEST_FIT, SEGREGATED_FIT or TLSF_FIT.  Applies to the
+ * default heap; other heaps get their policy from Mem_heap_create.
+ *
+ * SEGREGATED_FIT keeps small free chunks in exact-size bins so that small
+ * allocations and frees are O(1); larger requests fall back to first fit.
+ * BEST_FIT uses the same bins for small chunks and a size-ordered tree for
+ * the rest, so finding the best fit takes O(log n); compiling mem.c with
+ * MEM_BEST_FIT_SCAN brings back the old scan of one list, for comparison.
+ * TLSF_FIT (two-level segregated fit) files every free chunk by size class
+ * under two bitmaps, so allocation and free take constant time whatever
+ * the heap holds.
+ */
+extern int SearchPolicy;
+
+/* TRUE if memory returned to the free list of the default heap is
+ * coalesced
+ */
+extern int Coalescing;
+
+/* SBRK_SOURCE (the default) or MMAP_SOURCE: where the heap gets pages */
+extern int PageSource;
+
+/* requests of at least MmapThreshold bytes are given a mapping of their
+ * own, returned to the OS by Mem_free.  0 (the default) turns this off.
+ */
+extern int MmapThreshold;
+
+/* geometric heap growth.  When GrowMaxPages is above 0 every heap asks
+ * morecore for GrowMinPages pages the first time it grows and twice as
+ * many each time after, up to GrowMaxPages, or for what the request needs
+ * if that is more.  Fewer, larger morecore calls cut sbrk calls while a
+ * heap ramps up.  GrowMaxPages of 0 (the default) asks for exactly what
+ * each request needs.
+ */
+extern int GrowMinPages;
+extern int GrowMaxPages;
+
+/* whole free pages that have been idle for DecayMillis milliseconds are
+ * handed back to the OS with madvise, so resident memory shrinks after a
+ * spike.  Decay passes run from Mem_free now and then; 0 (the default)
+ * turns decay off.
+ */
+extern int DecayMillis;
+
+/* TRUE if heap growth should favour transparent huge pages: morecore is
+ * asked for regions that end on a 2 MB boundary, and every aligned 2 MB
+ * span of a new region is advised MADV_HUGEPAGE, which cuts TLB misses
+ * on a large heap.  FALSE (the default) asks for what each request needs.
+ */
+extern int HugePages;
+
+/* TRUE if the pages of every new region are faulted in as the heap grows,
+ * with MAP_POPULATE or by touching each page, instead of on first use.
+ * Growth gets slower and later allocations steadier.  FALSE by default.
+ */
+extern int Prefault;
+
+/* heap profiler: when ProfileBytes is above 0, Mem_alloc and
+ * Mem_alloc_aligned record the call stack of about one allocation in every
+ * ProfileBytes bytes (512 KB is a good rate), Mem_realloc keeps its size
+ * current, and Mem_free forgets the sample when the object goes.
+ * Mem_profile_dump writes what was sampled.  0 (the default) turns the
+ * profiler off at the cost of one test per Mem_alloc.
+ */
+extern int ProfileBytes;
+
+/* TRUE if Mem_alloc and Mem_free may be called from several threads.  The
+ * heap is then locked, and each thread caches recently freed small chunks
+ * so most calls never touch the lock.  Set it before the first Mem_alloc.
+ */
+extern int ThreadSafe;
 
 /* deallocates the space pointed to by return_ptr; it does nothing if
  * return_ptr is NULL.  
  */
 void Mem_free(void *return_ptr);
 
+/* deallocates the n objects in ptrs at once, skipping NULL entries.  It
+ * takes the heap lock once, and merges objects that come one after the
+ * other in both ptrs and the heap, as when a structure built in order is
+ * torn down in the same order.  The batch is not sorted: only pointers
+ * passed in address order have their runs merged, and any other order
+ * costs what one Mem_free per object would.
+ */
+void Mem_free_batch(void **ptrs, const int n);
+
 /* returns a pointer to space for an object of size nbytes, or NULL if the
  * request cannot be satisfied.  The space is uninitialized.
  */
 void *Mem_alloc(const int nbytes);
 
+/* returns a pointer to space for an object of size nbytes whose address
+ * is a multiple of alignment (a power of two), or NULL if the request
+ * cannot be satisfied.  The space is uninitialized and is released with
+ * Mem_free like any other object.
+ */
+void *Mem_alloc_aligned(const int alignment, const int nbytes);
+
+/* changes the size of the object pointed to by ptr to nbytes, keeping its
+ * contents up to the lesser of the old and new sizes.  The object is
+ * shrunk in place, grown in place when the next chunk is free and large
+ * enough, and moved otherwise.  Returns the (possibly new) pointer, or
+ * NULL if the request cannot be satisfied; ptr is then left unchanged.
+ * A NULL ptr behaves like Mem_alloc.
+ */
+void *Mem_realloc(void *ptr, const int nbytes);
+
+/* returns the chunks cached by the calling thread to the shared heap.  It
+ * runs automatically when a thread exits; call it before Mem_stats to see
+ * all free memory in the free list.
+ */
+void Mem_thread_flush(void);
+
+/* hands idle free pages of the default heap back to the OS now, as a
+ * decay pass would.  With DecayMillis 0 every whole free page goes back.
+ */
+void Mem_decay(void);
+
 /* prints stats about the current free list
  *
  * number of items in the linked list
  * min, max, and average size of each item (bytes)
  * total memory in list (bytes)
  * number of calls to sbrk and number of pages requested
+ * number of calls to mmap and the bytes held in large-chunk mappings
+ * number of reallocations done in place and by copying
+ * heap bytes retained from the OS and how many of them are resident
+ * heap bytes eligible for transparent huge pages
  */
 void Mem_stats(void);
 
@@ -39,17 +151,189 @@ void Mem_stats(void);
  *              p, p->size, p + p->size, p->next);
  */
 void Mem_print(void);
-/* an example of a chunk_t definition.  You must modify this to
- * match your design
+
+/* header placed in front of every chunk.  size counts units of
+ * sizeof(chunk_t), header included.  next links free chunks on a list and
+ * is unused while the chunk is allocated.  flags hold the boundary tags
+ * (in use, previous chunk free) that let Mem_free coalesce in O(1).
+ *
+ * Compiling everything with MEM_COMPACT_HEADER defined drops next, so the
+ * header and the unit are eight bytes instead of sixteen: a free chunk
+ * keeps its links in its own payload.  Small objects then take less
+ * memory, but objects are only aligned to eight bytes, and the smallest
+ * chunk is four units.
  *
  * We don't really need the definition of chunk_t in mem.h.  However,
  * for debugging it is nice to be able to print the size of chunk_t
  * in the drivers.
  * 
  */
+#ifdef MEM_COMPACT_HEADER
+typedef struct chunk_tag {
+    _Alignas(void *) int size;      // aligned so a unit can hold a link
+    int flags;
+} chunk_t;
+#else
 typedef struct chunk_tag {
     struct chunk_tag *next;
-    long size; 
+    int size;
+    int flags;
 } chunk_t;
+#endif
+
+/* a heap keeps its own free lists, regions, search policy, coalescing
+ * setting and statistics, so chunks of one heap never fragment another.
+ * Mem_alloc and Mem_free work on a default heap.
+ */
+typedef struct mem_heap_tag mem_heap_t;
+
+/* returns a new empty heap using search_policy, coalescing freed chunks if
+ * coalescing is TRUE, or NULL if the heap header cannot be allocated.  The
+ * calling thread owns the heap.
+ */
+mem_heap_t *Mem_heap_create(const int search_policy, const int coalescing);
+
+/* like Mem_alloc, but the space comes from heap H.  Small requests are not
+ * cached per thread.
+ */
+void *Mem_heap_alloc(mem_heap_t *H, const int nbytes);
+
+/* like Mem_free, for space that came from Mem_heap_alloc on heap H.  In
+ * thread-safe mode a thread other than the owner of H does not lock it,
+ * but queues the space for the owner to take back on its next
+ * Mem_heap_alloc.
+ */
+void Mem_heap_free(mem_heap_t *H, void *return_ptr);
+
+/* gives the memory of heap H back and frees H.  Mapped regions go to the
+ * OS; regions from sbrk have their pages purged and are reused by the next
+ * heap that grows.  Objects still allocated from H become invalid, except
+ * large ones with a mapping of their own, which must be freed first.  H
+ * must not be in use by other threads.
+ */
+void Mem_heap_destroy(mem_heap_t *H);
+
+/* makes the calling thread the owner of heap H, which is at first the
+ * thread that created it.  Call it before other threads free into H.
+ */
+void Mem_heap_adopt(mem_heap_t *H);
+
+/* like Mem_free_batch, for objects from heap H */
+void Mem_heap_free_batch(mem_heap_t *H, void **ptrs, const int n);
+
+/* like Mem_decay, for heap H */
+void Mem_heap_decay(mem_heap_t *H);
+
+/* like Mem_stats, for heap H */
+void Mem_heap_stats(mem_heap_t *H);
+
+/* starts recording every Mem_alloc, Mem_alloc_aligned, Mem_free and
+ * Mem_realloc on the default heap (size, address and time) to a binary
+ * file at path.
+ * Returns FALSE if the file cannot be opened.
+ */
+int Mem_trace_start(const char *path);
+
+/* finishes the trace file started by Mem_trace_start */
+void Mem_trace_stop(void);
+
+/* results of replaying a trace against one heap */
+typedef struct mem_replay_tag {
+    long num_ops;           // allocations and frees replayed
+    double ns_per_op;
+    int peak_pages;         // pages the heap took from morecore
+    int num_sbrk_calls;
+    int num_mmap_calls;
+    long peak_live_bytes;   // most bytes the trace held at once
+    double fragmentation;   // share of peak_pages not covered by peak_live_bytes
+    long p99_alloc_ns;      // allocation latency percentiles, worst case;
+    long p999_alloc_ns;     //   only filled in by Mem_trace_latency
+    long max_alloc_ns;
+} mem_replay_t;
+
+/* replays the trace at path against heap H, best a fresh one, and fills
+ * in R.  Returns FALSE if path is not a trace.
+ */
+int Mem_trace_replay(const char *path, mem_heap_t *H, mem_replay_t *R);
+
+/* like Mem_trace_replay, but also times every allocation on its own to
+ * fill in the latency fields of R
+ */
+int Mem_trace_latency(const char *path, mem_heap_t *H, mem_replay_t *R);
+
+/* replays the trace at path with every search policy, with and without
+ * coalescing, and prints a table of the results
+ */
+void Mem_trace_report(const char *path);
+
+/* writes the call stacks sampled by the heap profiler, with the live and
+ * total sampled objects and bytes of each, to the file path as a heap
+ * profile pprof can read (pprof <program> path).  Returns FALSE if the
+ * file cannot be opened.
+ */
+int Mem_profile_dump(const char *path);
+
+/* an arena (region) bump-allocates objects from blocks taken from the
+ * heap and frees all of them at once.  The arena header lives at the
+ * start of its first block.  An arena is not thread-safe itself, but
+ * several threads may each use their own.
+ */
+typedef struct mem_arena_tag {
+    chunk_t *first;         // blocks, in the order they were taken
+    chunk_t *current;       // block objects are being carved from
+    char *avail;            // next free byte in the current block
+    char *limit;            // end of the current block
+    int num_blocks;
+    long num_bytes;         // bytes handed out since the last reset
+} mem_arena_t;
+
+/* returns a new empty arena, or NULL if the heap cannot supply a block */
+mem_arena_t *Mem_arena_create(void);
+
+/* returns a pointer to space for an object of size nbytes carved from
+ * arena A, or NULL if the request cannot be satisfied.  The object can
+ * not be passed to Mem_free; it lives until A is reset or destroyed.
+ */
+void *Mem_arena_alloc(mem_arena_t *A, const int nbytes);
+
+/* frees every object in arena A in O(blocks).  The blocks are kept and
+ * reused by later allocations.
+ */
+void Mem_arena_reset(mem_arena_t *A);
+
+/* frees every object in arena A and returns its blocks to the heap */
+void Mem_arena_destroy(mem_arena_t *A);
+
+/* a slab hands out fixed-size slots carved from blocks taken from the
+ * heap.  Free slots are linked through their first word, so a slot has
+ * no header and allocating or freeing one is O(1).  Like an arena, a slab
+ * is not thread-safe itself.
+ */
+typedef struct mem_slab_tag {
+    int slot_bytes;         // size of one slot
+    int slots_per_block;
+    void *free_slots;       // free slots, linked through their first word
+    chunk_t *blocks;        // heap chunks carved into slots
+    int num_blocks;
+    long num_live;          // slots handed out and not yet freed
+} mem_slab_t;
+
+/* returns a new slab handing out slots of slot_bytes bytes, or NULL if the
+ * request cannot be satisfied
+ */
+mem_slab_t *Mem_slab_create(const int slot_bytes);
+
+/* returns a pointer to a free slot of S, or NULL if the heap cannot supply
+ * another block.  The slot is uninitialized.
+ */
+void *Mem_slab_alloc(mem_slab_t *S);
+
+/* returns the slot ptr to S; it does nothing if ptr is NULL */
+void Mem_slab_free(mem_slab_t *S, void *ptr);
+
+/* returns every block of S, and S itself, to the heap.  Slots still in use
+ * become invalid.
+ */
+void Mem_slab_destroy(mem_slab_t *S);
 
 /* vi:set ts=8 sts=4 sw=4 et: */
@@ -0,0 +1,684 @@
+/* mem_bench.c
+ * Purpose: compares Mem_alloc and Mem_free with the system malloc and free
+ *  on standard allocator workloads:
+ *
+ *      churn       random sizes allocated and freed in random order
+ *      lifetime    objects freed in the sorted order of their lifetimes
+ *      prodcons    one thread allocates, the others free what it made
+ *      larson      threads replace random objects, then pass their objects
+ *                  on to the next thread (Larson and Krishnan)
+ *      bst, table  inserts into an AVL tree and a chained hash table,
+ *                  with malloc nodes or nodes from a Mem slab
+ *
+ *  Each workload runs once with malloc and once with every search policy,
+ *  with coalescing on and off, and reports ops/sec, peak RSS and
+ *  fragmentation: the share of the memory the run added to its resident
+ *  set that was not holding live objects at the peak.  Every run is made
+ *  in a child process, so each starts from an empty heap and has its own
+ *  peak RSS, and is stopped after a time limit: some policies degrade
+ *  badly without coalescing, as their free lists fill with fragments, and
+ *  a stopped run is marked with a * and reports the rate it had reached.
+ *  Then larson is repeated with 1, 2, 4, ... threads, and a
+ *  trace of churn is replayed against every policy for allocation
+ *  latency percentiles (see Mem_trace_report).
+ *
+ *  Build:  gcc -O2 -o mem_bench mem_bench.c mem.c bst.c table.c -lpthread -lm
+ *  (add -DMEM_BEST_FIT_SCAN to measure best fit with its old list scan)
+ *  Usage:  mem_bench [-t threads] [-s scale] [-l seconds] [-w workload]
+ *
+ *  -t sets the threads of prodcons and larson (default 4), -s multiplies
+ *  the number of operations of every workload by a factor that may be a
+ *  fraction, such as 0.1 (default 1), -l sets the time limit of a run
+ *  (default 10) and -w runs only the named workload.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "mem.h"
+#include "bst.h"
+#include "table.h"
+
+#define MAX_THREADS     64
+#define RING_SLOTS      4096        // objects in flight to one consumer
+#define LARSON_SLOTS    2000        // objects owned by one larson array
+#define WHEEL_SLOTS     4096        // longest lifetime, in allocations
+#define TRACE_PATH      "/tmp/mem_bench.trace"
+#define TRACE_OPS       50000       // short, as every policy replays it twice
+
+// what a child reports about one run
+typedef struct bench_result_tag {
+    long ops;
+    double seconds;
+    long base_rss;          // resident bytes before the workload
+    long peak_rss;          // most resident bytes during the run
+    long peak_live;         // most bytes held in live objects
+    int expired;            // TRUE if the run hit the time limit
+} bench_result_t;
+
+typedef struct bench_workload_tag {
+    char *name;
+    int threaded;           // TRUE if the heap must be thread-safe
+    void (*run)(bench_result_t *R);
+} bench_workload_t;
+
+// one consumer's queue: the producer writes at head, the consumer reads
+// at tail
+typedef struct bench_ring_tag {
+    _Atomic long head;
+    char pad1[64];
+    _Atomic long tail;
+    char pad2[64];
+    void *slot[RING_SLOTS];
+} bench_ring_t;
+
+// objects of one larson array, which moves from thread to thread
+typedef struct bench_array_tag {
+    void *obj[LARSON_SLOTS];
+    int size[LARSON_SLOTS];
+    long live;
+    long peak_live;
+} bench_array_t;
+
+// Settings of the child process.  UseMem picks Mem_alloc over malloc;
+// BenchHeap, when set, is the producer's own heap in prodcons.
+static int UseMem;
+static mem_heap_t *BenchHeap = NULL;
+static int NumThreads = 4;
+static double Scale = 1;
+static int TimeLimit = 10;
+static long ChurnOps = 1000000;
+static volatile sig_atomic_t Expired;     // set when TimeLimit has passed
+
+static bench_ring_t *Rings;
+static _Atomic long FreedBytes;
+static bench_array_t *Arrays;
+static pthread_barrier_t Barrier;
+static int Generations = 10;
+static long RoundsPerGeneration;
+static _Atomic long LarsonOps;
+
+// private function prototypes
+void *bench_alloc(int nbytes);
+void bench_free(void *ptr);
+unsigned int bench_rand(unsigned int *state);
+int bench_size(unsigned int *state, int small, int large);
+long bench_rss(void);
+long bench_peak_rss(void);
+double bench_seconds(struct timespec *from, struct timespec *to);
+void bench_expire(int sig);
+void bench_churn(bench_result_t *R);
+void bench_lifetime(bench_result_t *R);
+void *bench_consumer(void *arg);
+void bench_prodcons(bench_result_t *R);
+void *bench_larson_thread(void *arg);
+void bench_larson(bench_result_t *R);
+void bench_bst(bench_result_t *R);
+void bench_table(bench_result_t *R);
+int bench_child(bench_workload_t *W, int useMem, int policy, int coalescing,
+        bench_result_t *R);
+void bench_print(char *workload, char *allocator, char *policy, char *coalescing,
+        bench_result_t *R);
+void bench_trace_report(void);
+
+static bench_workload_t Workloads[] = {
+    {"churn", FALSE, bench_churn},
+    {"lifetime", FALSE, bench_lifetime},
+    {"prodcons", TRUE, bench_prodcons},
+    {"larson", TRUE, bench_larson},
+    {"bst", FALSE, bench_bst},
+    {"table", FALSE, bench_table},
+};
+
+/* bench_alloc, bench_free
+ * the allocator under test
+ */
+void *bench_alloc(int nbytes)
+{
+    if (BenchHeap != NULL)
+        return Mem_heap_alloc(BenchHeap, nbytes);
+    return UseMem ? Mem_alloc(nbytes) : malloc(nbytes);
+}
+
+void bench_free(void *ptr)
+{
+    if (BenchHeap != NULL)
+        Mem_heap_free(BenchHeap, ptr);
+    else if (UseMem)
+        Mem_free(ptr);
+    else
+        free(ptr);
+}
+
+/* bench_rand
+ * RETURNS the next number of a xorshift generator; state must not be 0
+ */
+unsigned int bench_rand(unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* bench_size
+ * RETURNS a request size: 16 to small bytes four times in five, otherwise
+ * up to large bytes, as most programs allocate many small objects and a
+ * few large ones
+ */
+int bench_size(unsigned int *state, int small, int large)
+{
+    unsigned int r = bench_rand(state);
+
+    if (r % 5 != 0)
+        return 16 + (r >> 8) % (small - 15);
+    return 16 + (r >> 8) % (large - 15);
+}
+
+/* bench_rss, bench_peak_rss
+ * RETURN the resident and the peak resident bytes of this process
+ */
+long bench_rss(void)
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp != NULL) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+long bench_peak_rss(void)
+{
+    char line[256];
+    long kb = 0;
+    FILE *fp = fopen("/proc/self/status", "r");
+
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0)
+            kb = atol(line + 6);
+    }
+    fclose(fp);
+    return kb * 1024;
+}
+
+/* RETURNS the seconds from from to to */
+double bench_seconds(struct timespec *from, struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* bench_expire
+ * SIGALRM handler that ends the running workload
+ */
+void bench_expire(int sig)
+{
+    (void) sig;
+    Expired = TRUE;
+}
+
+/* bench_churn
+ * allocates into or frees a random one of 20000 slots, ChurnOps times,
+ * with sizes up to 4 KB
+ */
+void bench_churn(bench_result_t *R)
+{
+    int n = 20000, i, *size;
+    long op, live = 0;
+    unsigned int seed = 12345;
+    char **obj;
+    struct timespec start, stop;
+
+    obj = calloc(n, sizeof(char *));
+    size = calloc(n, sizeof(int));
+    R->base_rss = bench_rss();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (op = 0; op < ChurnOps && !Expired; op++) {
+        i = bench_rand(&seed) % n;
+        if (obj[i] != NULL) {
+            bench_free(obj[i]);
+            obj[i] = NULL;
+            live -= size[i];
+        } else {
+            size[i] = bench_size(&seed, 256, 4096);
+            obj[i] = bench_alloc(size[i]);
+            obj[i][0] = obj[i][size[i] - 1] = 1;
+            live += size[i];
+            if (live > R->peak_live)
+                R->peak_live = live;
+        }
+    }
+    for (i = 0; i < n; i++)
+        bench_free(obj[i]);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    R->ops = op + n;
+    R->seconds = bench_seconds(&start, &stop);
+}
+
+/* bench_lifetime
+ * allocates one object per step with a lifetime of 1 to WHEEL_SLOTS steps,
+ * spread evenly over the powers of two, and frees every object whose
+ * lifetime ends, so objects die in the sorted order of their death times
+ * rather than in allocation order.  The objects due at a step are linked
+ * through their first word.
+ */
+void bench_lifetime(bench_result_t *R)
+{
+    void **wheel, **p, *next;
+    long step, ops = 0, live = 0;
+    int life, nbytes, i;
+    unsigned int seed = 777;
+    struct timespec start, stop;
+
+    wheel = calloc(WHEEL_SLOTS, sizeof(void *));
+    R->base_rss = bench_rss();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (step = 0; step < 500000 * Scale && !Expired; step++) {
+        for (p = wheel[step % WHEEL_SLOTS]; p != NULL; p = next) {
+            next = p[0];
+            live -= (long) p[1];
+            bench_free(p);
+            ops++;
+        }
+        wheel[step % WHEEL_SLOTS] = NULL;
+
+        life = 1 + bench_rand(&seed) % (1 << (bench_rand(&seed) % 12));
+        nbytes = bench_size(&seed, 256, 2048);
+        p = bench_alloc(nbytes);
+        p[1] = (void *) (long) nbytes;
+        p[0] = wheel[(step + life) % WHEEL_SLOTS];
+        wheel[(step + life) % WHEEL_SLOTS] = p;
+        ops++;
+        live += nbytes;
+        if (live > R->peak_live)
+            R->peak_live = live;
+    }
+    for (i = 0; i < WHEEL_SLOTS; i++) {
+        for (p = wheel[i]; p != NULL; p = next) {
+            next = p[0];
+            bench_free(p);
+            ops++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    R->ops = ops;
+    R->seconds = bench_seconds(&start, &stop);
+}
+
+/* bench_consumer
+ * frees what the producer puts on ring arg until it sends NULL
+ */
+void *bench_consumer(void *arg)
+{
+    bench_ring_t *ring = arg;
+    long tail = 0, bytes = 0;
+    void *p;
+
+    for (;;) {
+        while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail)
+            sched_yield();
+        p = ring->slot[tail % RING_SLOTS];
+        atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+        if (p == NULL)
+            break;
+        bytes += *(int *) p;
+        bench_free(p);
+        if (tail % 256 == 0) {
+            atomic_fetch_add_explicit(&FreedBytes, bytes, memory_order_relaxed);
+            bytes = 0;
+        }
+    }
+    atomic_fetch_add_explicit(&FreedBytes, bytes, memory_order_relaxed);
+    return NULL;
+}
+
+/* bench_prodcons
+ * the calling thread allocates 500000 objects per unit of scale and
+ * deals them round robin to NumThreads - 1 consumers, which free them.
+ * With Mem the objects come from a heap the producer owns, so consumers
+ * hand them back through its remote-free queue.
+ */
+void bench_prodcons(bench_result_t *R)
+{
+    pthread_t tid[MAX_THREADS];
+    int consumers = NumThreads > 1 ? NumThreads - 1 : 1, c, nbytes;
+    long i, n = 500000 * Scale, head[MAX_THREADS], allocated = 0, live, ops = 0;
+    unsigned int seed = 99;
+    bench_ring_t *ring;
+    void *p;
+    struct timespec start, stop;
+
+    Rings = calloc(consumers, sizeof(bench_ring_t));
+    memset(head, 0, sizeof(head));
+    if (UseMem)
+        BenchHeap = Mem_heap_create(SearchPolicy, Coalescing);
+    R->base_rss = bench_rss();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (c = 0; c < consumers; c++)
+        pthread_create(&tid[c], NULL, bench_consumer, &Rings[c]);
+    for (i = 0; i < n + consumers; i++) {
+        c = i % consumers;
+        ring = &Rings[c];
+        p = NULL;       // a NULL stops the consumer
+        if (i < n && !Expired) {
+            nbytes = 64 + bench_rand(&seed) % 960;
+            p = bench_alloc(nbytes);
+            *(int *) p = nbytes;
+            allocated += nbytes;
+            ops += 2;
+        } else if (i < n) {
+            i = n - 1;
+            continue;
+        }
+        while (head[c] - atomic_load_explicit(&ring->tail, memory_order_acquire) >= RING_SLOTS)
+            sched_yield();
+        ring->slot[head[c] % RING_SLOTS] = p;
+        atomic_store_explicit(&ring->head, ++head[c], memory_order_release);
+        if (i % 256 == 0) {
+            live = allocated - atomic_load_explicit(&FreedBytes, memory_order_relaxed);
+            if (live > R->peak_live)
+                R->peak_live = live;
+        }
+    }
+    for (c = 0; c < consumers; c++)
+        pthread_join(tid[c], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    R->ops = ops;
+    R->seconds = bench_seconds(&start, &stop);
+}
+
+/* bench_larson_thread
+ * in each generation replaces RoundsPerGeneration random objects of one
+ * array, then waits for the other threads and moves on to the array the
+ * previous thread used, freeing objects another thread allocated
+ */
+void *bench_larson_thread(void *arg)
+{
+    long k = (long) arg, r;
+    int g, i;
+    unsigned int seed = 1 + k;
+    bench_array_t *A;
+
+    for (g = 0; g < Generations; g++) {
+        A = &Arrays[(k + g) % NumThreads];
+        for (r = 0; r < RoundsPerGeneration && !Expired; r++) {
+            i = bench_rand(&seed) % LARSON_SLOTS;
+            if (A->obj[i] != NULL) {
+                bench_free(A->obj[i]);
+                A->live -= A->size[i];
+            }
+            A->size[i] = 16 + bench_rand(&seed) % 497;
+            A->obj[i] = bench_alloc(A->size[i]);
+            *(char *) A->obj[i] = 1;
+            A->live += A->size[i];
+            if (A->live > A->peak_live)
+                A->peak_live = A->live;
+        }
+        atomic_fetch_add(&LarsonOps, 2 * r);
+        pthread_barrier_wait(&Barrier);
+    }
+    return NULL;
+}
+
+/* bench_larson
+ * runs NumThreads larson threads for Generations generations, 1 million
+ * replacements per unit of scale in all
+ */
+void bench_larson(bench_result_t *R)
+{
+    pthread_t tid[MAX_THREADS];
+    long k;
+    int i;
+    struct timespec start, stop;
+
+    Arrays = calloc(NumThreads, sizeof(bench_array_t));
+    RoundsPerGeneration = 1000000 * Scale / Generations / NumThreads;
+    pthread_barrier_init(&Barrier, NULL, NumThreads);
+    R->base_rss = bench_rss();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < NumThreads; k++)
+        pthread_create(&tid[k], NULL, bench_larson_thread, (void *) k);
+    for (k = 0; k < NumThreads; k++)
+        pthread_join(tid[k], NULL);
+    for (k = 0; k < NumThreads; k++) {
+        for (i = 0; i < LARSON_SLOTS; i++)
+            bench_free(Arrays[k].obj[i]);
+        R->peak_live += Arrays[k].peak_live;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    R->ops = LarsonOps;
+    R->seconds = bench_seconds(&start, &stop);
+}
+
+/* bench_bst
+ * inserts 200000 random keys per unit of scale into an AVL tree, whose
+ * nodes come from malloc or from a Mem slab, then destroys it
+ */
+void bench_bst(bench_result_t *R)
+{
+    long i, n = 200000 * Scale;
+    unsigned int seed = 4242;
+    mem_slab_t *S = NULL;
+    bst_t *T;
+    struct timespec start, stop;
+
+    R->base_rss = bench_rss();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (UseMem)
+        S = Mem_slab_create(sizeof(bst_node_t));
+    T = bst_construct_slab(AVL, S);
+    for (i = 0; i < n; i++)
+        bst_insert(T, bench_rand(&seed) & 0x7fffffff, NULL);
+    R->peak_live = (long) bst_size(T) * sizeof(bst_node_t);
+    bst_destruct(T);
+    Mem_slab_destroy(S);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    R->ops = n;
+    R->seconds = bench_seconds(&start, &stop);
+}
+
+/* bench_table
+ * inserts 200000 distinct keys per unit of scale into a chained table,
+ * whose nodes come from malloc or from a Mem slab, then destroys it.  The
+ * keys are made before the clock starts.
+ */
+void bench_table(bench_result_t *R)
+{
+    long i, n = 200000 * Scale;
+    char **keys, buf[32];
+    mem_slab_t *S = NULL;
+    table_t *T;
+    struct timespec start, stop;
+
+    keys = malloc(n * sizeof(char *));
+    for (i = 0; i < n; i++) {
+        sprintf(buf, "key%ld", i * 7919 % n);
+        keys[i] = strdup(buf);
+    }
+    R->base_rss = bench_rss();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (UseMem)
+        S = Mem_slab_create(sizeof(sep_chain_t));
+    T = table_construct_slab(n / 2 + 1, CHAIN, S);
+    for (i = 0; i < n; i++)
+        table_insert(T, keys[i], NULL);
+    R->peak_live = n * sizeof(sep_chain_t);
+    table_destruct(T);
+    Mem_slab_destroy(S);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    R->ops = n;
+    R->seconds = bench_seconds(&start, &stop);
+}
+
+/* bench_child
+ * runs workload W in a child process, with malloc or with Mem set to the
+ * given policy and coalescing, and collects its results in R
+ *
+ * returns TRUE, or FALSE if the child failed
+ */
+int bench_child(bench_workload_t *W, int useMem, int policy, int coalescing,
+        bench_result_t *R)
+{
+    int fds[2], status;
+    pid_t pid;
+
+    memset(R, 0, sizeof(bench_result_t));
+    if (pipe(fds) != 0)
+        return FALSE;
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        UseMem = useMem;
+        SearchPolicy = policy;
+        Coalescing = coalescing;
+        ThreadSafe = W->threaded;
+        signal(SIGALRM, bench_expire);
+        alarm(TimeLimit);
+        W->run(R);
+        R->expired = Expired;
+        R->peak_rss = bench_peak_rss();
+        if (write(fds[1], R, sizeof(bench_result_t)) != sizeof(bench_result_t))
+            _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    status = (pid > 0 && read(fds[0], R, sizeof(bench_result_t)) == sizeof(bench_result_t));
+    close(fds[0]);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    return status;
+}
+
+/* bench_print
+ * prints one line of results
+ */
+void bench_print(char *workload, char *allocator, char *policy, char *coalescing,
+        bench_result_t *R)
+{
+    long grown = R->peak_rss - R->base_rss;
+
+    printf("%-10s %-7s %-15s %-9s %9.2f%c %10.1f", workload, allocator, policy,
+            coalescing, R->ops / R->seconds / 1e6, R->expired ? '*' : ' ',
+            R->peak_rss / 1048576.0);
+    if (grown > 0)
+        printf(" %7.1f%%\n", 100.0 * (1.0 - (double) R->peak_live / grown));
+    else
+        printf(" %8s\n", "-");
+}
+
+/* bench_trace_report
+ * records a short trace of churn and replays it against every policy, with and
+ * without coalescing, for throughput, fragmentation and the tail latency
+ * of allocations
+ */
+void bench_trace_report(void)
+{
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        UseMem = TRUE;
+        ChurnOps = TRACE_OPS;
+        if (Mem_trace_start(TRACE_PATH) == FALSE)
+            _exit(1);
+        bench_churn(&(bench_result_t) {0});
+        Mem_trace_stop();
+        printf("\nchurn trace replayed against fresh heaps:");
+        Mem_trace_report(TRACE_PATH);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    unlink(TRACE_PATH);
+}
+
+int main(int argc, char **argv)
+{
+    int policies[] = {FIRST_FIT, BEST_FIT, SEGREGATED_FIT, TLSF_FIT};
+    char *names[] = {"first fit", "best fit", "segregated fit", "tlsf"};
+    char *only = NULL;
+    int i, w, c, threads, opt;
+    bench_workload_t *larson = NULL;
+    bench_result_t R;
+
+    while ((opt = getopt(argc, argv, "t:s:l:w:")) != -1) {
+        if (opt == 't')
+            NumThreads = atoi(optarg);
+        else if (opt == 's')
+            Scale = atof(optarg);
+        else if (opt == 'l')
+            TimeLimit = atoi(optarg);
+        else if (opt == 'w')
+            only = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-t threads] [-s scale] [-l seconds] [-w workload]\n", argv[0]);
+            exit(1);
+        }
+    }
+    ChurnOps *= Scale;
+    if (NumThreads < 1 || NumThreads > MAX_THREADS || Scale <= 0 || TimeLimit < 1) {
+        fprintf(stderr, "threads must be 1 to %d, scale above 0 and limit at least 1\n",
+                MAX_THREADS);
+        exit(1);
+    }
+
+    printf("%-10s %-7s %-15s %-9s %10s %10s %8s\n", "workload", "alloc", "policy",
+            "coalesce", "Mops/s", "peak MB", "frag");
+    for (w = 0; w < (int) (sizeof(Workloads) / sizeof(Workloads[0])); w++) {
+        if (strcmp(Workloads[w].name, "larson") == 0)
+            larson = &Workloads[w];
+        if (only != NULL && strcmp(only, Workloads[w].name) != 0)
+            continue;
+        if (bench_child(&Workloads[w], FALSE, FIRST_FIT, TRUE, &R) == TRUE)
+            bench_print(Workloads[w].name, "malloc", "-", "-", &R);
+        for (i = 0; i < (int) (sizeof(policies) / sizeof(policies[0])); i++) {
+            for (c = TRUE; c >= FALSE; c--) {
+                if (bench_child(&Workloads[w], TRUE, policies[i], c, &R) == TRUE)
+                    bench_print(Workloads[w].name, "mem", names[i], c ? "yes" : "no", &R);
+                else
+                    printf("%-10s %-7s %-15s run failed\n", Workloads[w].name, "mem", names[i]);
+            }
+        }
+    }
+    if (only != NULL && strcmp(only, "larson") != 0)
+        return 0;
+
+    printf("\nlarson scaling, Mops/s (mem: segregated fit, coalescing)\n");
+    printf("%8s %10s %10s\n", "threads", "malloc", "mem");
+    for (threads = 1; threads <= NumThreads; threads *= 2) {
+        i = NumThreads;
+        NumThreads = threads;
+        printf("%8d", threads);
+        if (bench_child(larson, FALSE, FIRST_FIT, TRUE, &R) == TRUE)
+            printf(" %10.2f", R.ops / R.seconds / 1e6);
+        if (bench_child(larson, TRUE, SEGREGATED_FIT, TRUE, &R) == TRUE)
+            printf(" %10.2f", R.ops / R.seconds / 1e6);
+        printf("\n");
+        NumThreads = i;
+    }
+
+    if (only == NULL)
+        bench_trace_report();
+    return 0;
+}
+
+/* vi:set ts=8 sts=4 sw=4 et: */
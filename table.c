@@ -13,15 +13,65 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "table.h"
+#include "mem.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define EmptyKey NULL 
 #define DeleteKey 1
 #define PRIME 5
 
+/* SWISS tags: a stored key's tag is 7 bits of its hash, so the top bit
+ * marks slots that hold no key
+ */
+#define TagEmpty 0x80
+#define TagDeleted 0xFE
+#define GroupWidth 16
+
+/* auto-resize: the fewest slots of the old table moved per insert or
+ * delete, and the smallest size a table shrinks to
+ */
+#define MigrateSlots 8
+#define MinTableSize 11
+
+/* Keys are only compared when their stored hashes are equal.  Build with
+ * -DTABLE_NO_FINGERPRINT to compare every key probed, for measurements.
+ */
+#ifdef TABLE_NO_FINGERPRINT
+#define SameHash(kh, h) ((void) (kh), (void) (h), 1)
+#else
+#define SameHash(kh, h) ((kh) == (h))
+#endif
+
 int equal_key(char *k1, char *k2);
-/* probing_type is one of LINEAR, DOUBLE, CHAIN */
+int match_key(table_t *T, hashkey_t k, unsigned int kh, hashkey_t key,
+        unsigned int h);
+sep_chain_t *alloc_chain(table_t *T);
+void free_chain(table_t *T, sep_chain_t *node);
+unsigned int tag_of(unsigned int h);
+void set_tag(table_t *T, int slot, unsigned char tag);
+unsigned int group_match(unsigned char *group, unsigned char tag);
+unsigned int group_free(unsigned char *group);
+int swiss_find(table_t *T, hashkey_t key, unsigned int h);
+int swiss_free_slot(table_t *T, unsigned int h);
+int robin_find(table_t *T, hashkey_t key, unsigned int h);
+int robin_insert(table_t *T, hashkey_t key, data_t D, unsigned int h);
+void remove_slot(table_t *T, int addr);
+int insert_entry(table_t *T, hashkey_t key, data_t D, unsigned int h);
+data_t delete_entry(table_t *T, hashkey_t key, unsigned int h);
+data_t *locate_entry(table_t *T, hashkey_t key, unsigned int h);
+uint64_t fast_mix(uint64_t a, uint64_t b);
+unsigned int fast_hash(hashkey_t key);
+int next_prime(int n);
+void start_resize(table_t *T, int new_table_size);
+void migrate_slot(table_t *T, table_t *old, int slot);
+void resize_step(table_t *T);
+/* probing_type is one of LINEAR, DOUBLE, CHAIN, SWISS, ROBIN */
 
 unsigned int hash(hashkey_t key)
 {
@@ -30,13 +80,65 @@ unsigned int hash(hashkey_t key)
     char *p = key;
     int i;
 
-    for (i = 0; i < strlen(key); i++) {
+    for (i = 0; p[i] != '\0'; i++) {
         h = 33 * h ^ p[i];
     }
 
     return h;
 }
 
+/* Multiplies a and b to 128 bits and folds the halves together, which
+ * spreads every input bit over the whole result
+ */
+uint64_t fast_mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t) a * b;
+
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+/* The FASTHASH hash: mixes the key 8 bytes at a time in the manner of
+ * wyhash.  The last word is read so that it ends with the key, and keys
+ * of up to 8 bytes are read as two overlapping halves, so there is never
+ * a byte-by-byte tail.
+ */
+unsigned int fast_hash(hashkey_t key)
+{
+    size_t len = strlen(key), i;
+    uint64_t h = 0xa0761d6478bd642full ^ len, w;
+    uint32_t lo, hi;
+
+    if (len > 8) {
+        for (i = 0; i + 8 < len; i += 8) {
+            memcpy(&w, key + i, 8);
+            h = fast_mix(w ^ 0xe7037ed1a0b428dbull, h ^ 0x8ebc6af09c88c6e3ull);
+        }
+        memcpy(&w, key + len - 8, 8);
+    } else if (len >= 4) {
+        memcpy(&lo, key, 4);
+        memcpy(&hi, key + len - 4, 4);
+        w = (uint64_t) hi << 32 | lo;
+    } else if (len > 0) {
+        w = (uint64_t) (unsigned char) key[0] << 16
+                | (uint64_t) (unsigned char) key[len >> 1] << 8
+                | (unsigned char) key[len - 1];
+    } else {
+        w = 0;
+    }
+    h = fast_mix(w ^ 0xe7037ed1a0b428dbull, h ^ 0x589965cc75374cc3ull);
+    h = fast_mix(h, 0x8ebc6af09c88c6e3ull);
+    return (unsigned int) (h ^ (h >> 32));
+}
+
+/* RETURNS the hash of key by hash_function, see table.h */
+unsigned int table_hash(int hash_function, hashkey_t key)
+{
+    if (hash_function == FASTHASH) {
+        return fast_hash(key);
+    }
+    return hash(key);
+}
+
 unsigned int probe(int addr)
 {
     unsigned h = 0;    
@@ -56,34 +158,55 @@ unsigned int probe(int addr)
  */
 table_t *table_construct (int table_size, int probing_type)
 {
-	/* TODO: allocate memory for table and populate each entry */
-    int i;
+    return table_construct_slab(table_size, probing_type, NULL);
+}
+
+/* Same as table_construct, but separate chaining nodes are taken from
+ * slab instead of malloc when slab is not NULL.
+ */
+table_t *table_construct_slab(int table_size, int probing_type,
+        struct mem_slab_tag *slab)
+{
+    return table_construct_hash(table_size, probing_type, HASH33, slab);
+}
+
+/* Same as table_construct_slab, but keys are hashed by hash_function.
+ */
+table_t *table_construct_hash(int table_size, int probing_type,
+        int hash_function, struct mem_slab_tag *slab)
+{
+    assert(slab == NULL || slab->slot_bytes >= (int) sizeof(sep_chain_t));
     table_t *T = (table_t *)malloc(sizeof(table_t));
     if (T == NULL) {
     	return NULL;
     }
     
+	T->node_slab = slab;
 	T->table_size = table_size;
 	T->probing_type = probing_type;
+	T->hash_function = hash_function;
 	T->num_stored_keys = 0;
 	T->num_probes_for_most_recent_call = 0;
+	T->num_deleted = 0;
+	T->num_key_compares = 0;
+	T->tags = NULL;
+	T->max_load = T->min_load = T->max_deleted = 0;
+	T->old = NULL;
+	T->migrate_pos = 0;
+	T->migrate_slots = MigrateSlots;
 	
 	if (probing_type != CHAIN) {
-		T->oa = (table_entry_t *)malloc(sizeof(table_entry_t) * T->table_size);
-		
-		for (i = 0; i < T->table_size; i++) {
-			T->oa[i].key = EmptyKey;
-			T->oa[i].data_ptr = NULL;
-			T->oa[i].deleted = 0;
-		}
+		// zeroed slots are empty: EmptyKey, no data, not deleted.  calloc
+		// gets large tables from fresh pages, so nothing is touched yet
+		T->oa = (table_entry_t *)calloc(T->table_size, sizeof(table_entry_t));
+	}
+	if (probing_type == SWISS) {
+	    // a group starting at any slot can be loaded without wrapping
+	    T->tags = (unsigned char *)malloc(T->table_size + GroupWidth);
+	    memset(T->tags, TagEmpty, T->table_size + GroupWidth);
 	}
 	else if (probing_type == CHAIN) {
-		T->sc = (sep_chain_t **)malloc(sizeof(sep_chain_t) * (T->table_size));
-
-		for (i = 0; i < T->table_size; i++) {
-			//T->sc[i] = (sep_chain_t *)malloc(sizeof(sep_chain_t));
-			T->sc[i] = NULL;
-		}
+		T->sc = (sep_chain_t **)calloc(T->table_size, sizeof(sep_chain_t *));
 	}
 
     return T;
@@ -104,12 +227,18 @@ table_t *table_rehash (table_t * T, int new_table_size)
     }
     /* TODO: build new table to rehash. destroy the old table */
     int i;// check;
-    table_t *new_table = table_construct(new_table_size, T->probing_type);
-    printf("\n");
+    while (T->old != NULL) {
+        resize_step(T);
+    }
+    table_t *new_table = table_construct_hash(new_table_size, T->probing_type,
+            T->hash_function, T->node_slab);
+    table_auto_resize(new_table, T->max_load, T->min_load, T->max_deleted);
+    new_table->num_key_compares = T->num_key_compares;
     for (i = 0; i < T->table_size; i++) {
     	if (T->oa[i].key != EmptyKey) {
     		//printf("Key: %s \t Data: %p\n", T->oa[i].key, T->oa[i].data_ptr);
-    		table_insert(new_table, strdup(T->oa[i].key), T->oa[i].data_ptr);
+    		insert_entry(new_table, strdup(T->oa[i].key), T->oa[i].data_ptr,
+    		        T->oa[i].hash);
     	}
     	//printf("check = %d\n", check);
     	//assert(check == 0);
@@ -124,6 +253,9 @@ table_t *table_rehash (table_t * T, int new_table_size)
 int table_entries (table_t *T)
 {
     /* TODO */
+    if (T->old != NULL) {
+        return T->num_stored_keys + T->old->num_stored_keys;
+    }
     return T->num_stored_keys;
 }
 
@@ -148,6 +280,9 @@ int table_deletekeys(table_t *T)
 {
     /* TODO: count the keys that are 'deleted' remember chaining is different */
     int i, count = 0;
+    if (T->old != NULL) {
+    	count = table_deletekeys(T->old);
+    }
     if (T->probing_type != CHAIN) {
     	for (i = 0; i < T->table_size; i++) {
     		if (T->oa[i].deleted == DeleteKey) {
@@ -167,7 +302,7 @@ int table_deletekeys(table_t *T)
     	}
     } */
     
-    return 0;
+    return count;
 }
    
 /* Insert a new table entry (K, I) into the table provided the table is not
@@ -178,14 +313,59 @@ int table_deletekeys(table_t *T)
  *     -1 if the * (K, I) pair cannot be inserted.
  */
 int table_insert (table_t *T, hashkey_t key, data_t D)
+{
+    data_t *old_data;
+    unsigned int h = table_hash(T->hash_function, key);
+
+    if (T->old != NULL || T->max_load > 0) {
+        resize_step(T);
+    }
+    // a key waiting to be migrated is updated where it is
+    if (T->old != NULL && (old_data = locate_entry(T->old, key, h)) != NULL) {
+        T->num_probes_for_most_recent_call = T->old->num_probes_for_most_recent_call;
+        *old_data = D;
+        return 1;
+    }
+    return insert_entry(T, key, D, h);
+}
+
+/* Inserts (K, I), where K has hash h, into the slots of T, ignoring any
+ * table being migrated into it.  h is kept with the entry so that moving
+ * it to other slots never hashes K again.  Returns as table_insert.
+ */
+int insert_entry(table_t *T, hashkey_t key, data_t D, unsigned int h)
 {
     int addr, first_addr, prob_dec;
     sep_chain_t *new;
     T->num_probes_for_most_recent_call = 0;
-    addr = hash(key) % T->table_size;
+    addr = h % T->table_size;
     first_addr = addr;
     int M = T->table_size;
     
+    if (T->probing_type == SWISS) {
+        addr = swiss_find(T, key, h);
+        if (addr >= 0) {
+            T->oa[addr].data_ptr = D;
+            return 1;
+        }
+        if (table_full(T)) {
+            return -1;
+        }
+        addr = swiss_free_slot(T, h);
+        if (T->oa[addr].deleted == DeleteKey) {
+            T->num_deleted--;
+        }
+        T->oa[addr].key = key;
+        T->oa[addr].data_ptr = D;
+        T->oa[addr].deleted = 0;
+        T->oa[addr].hash = h;
+        set_tag(T, addr, tag_of(h));
+        T->num_stored_keys++;
+        return 0;
+    }
+    if (T->probing_type == ROBIN) {
+        return robin_insert(T, key, D, h);
+    }
     if (table_full(T)) {
     	return -1;
     }
@@ -197,33 +377,55 @@ int table_insert (table_t *T, hashkey_t key, data_t D)
         	prob_dec = 1;
         } else
         	prob_dec = probe(addr);
+		// the key may be past deleted slots, but not past an empty one;
+		// it goes in the first deleted or empty slot on the way
+		int free_addr = -1;
 		do {
 			T->num_probes_for_most_recent_call++;
-			if ((T->oa[addr].key == EmptyKey) || (T->oa[addr].deleted == DeleteKey)) {
-				T->oa[addr].key = key;
-				T->oa[addr].data_ptr = D;
-				T->oa[addr].deleted = 0;
-				return 0;
-			} 
-			else if (equal_key(T->oa[addr].key, key)) {
+			if (T->oa[addr].deleted == DeleteKey) {
+				if (free_addr < 0) {
+					free_addr = addr;
+				}
+			}
+			else if (T->oa[addr].key == EmptyKey) {
+				if (free_addr < 0) {
+					free_addr = addr;
+				}
+				break;
+			}
+			else if (match_key(T, T->oa[addr].key, T->oa[addr].hash, key, h)) {
 				T->num_probes_for_most_recent_call++;
 				T->oa[addr].data_ptr = D;
+				T->num_stored_keys--;
 				return 1;
 			}
 			T->num_probes_for_most_recent_call++;
 			addr = (addr + prob_dec) % M;
 			
 		} while (addr != first_addr);
+		if (free_addr >= 0) {
+			addr = free_addr;
+			if (T->oa[addr].deleted == DeleteKey) {
+				T->num_deleted--;
+			}
+			T->oa[addr].key = key;
+			T->oa[addr].data_ptr = D;
+			T->oa[addr].deleted = 0;
+			T->oa[addr].hash = h;
+			return 0;
+		}
+		T->num_stored_keys--;
+		return -1;
     }
 
     else { // CHAIN
-    	new = (sep_chain_t *)malloc(sizeof(sep_chain_t));
+    	new = alloc_chain(T);
     	if (new == NULL) {
-    		free(new);
     		return -1;
     	}
     	new->key = key;
     	new->data_ptr = D;
+    	new->hash = h;
     	new->next = NULL;
     	
 		//chain is empty
@@ -231,12 +433,17 @@ int table_insert (table_t *T, hashkey_t key, data_t D)
         	T->sc[addr] = new;        	
         } else { // chain is not empty
             sep_chain_t *current = T->sc[addr];
-            while (current->next != NULL) {
-            	if (equal_key(current->key, new->key)) {
-            		current = new;
+            for (;;) {
+            	if (match_key(T, current->key, current->hash, key, h)) {
+            		current->data_ptr = D;
+            		free_chain(T, new);
+            		T->num_stored_keys--;
             		return 1;
             	}
             	T->num_probes_for_most_recent_call++;
+            	if (current->next == NULL) {
+            		break;
+            	}
             	current = current->next;
             }
             current->next = new;
@@ -255,62 +462,70 @@ int table_insert (table_t *T, hashkey_t key, data_t D)
  * deletions when using open addressing.
  */
 data_t table_delete (table_t *T, hashkey_t key) 
+{
+    data_t D;
+    int probes;
+    unsigned int h = table_hash(T->hash_function, key);
+
+    if (T->old != NULL || T->max_load > 0) {
+        resize_step(T);
+    }
+    D = delete_entry(T, key, h);
+    if (D == NULL && T->old != NULL) {
+        probes = T->num_probes_for_most_recent_call;
+        D = delete_entry(T->old, key, h);
+        T->num_probes_for_most_recent_call = probes + T->old->num_probes_for_most_recent_call;
+    }
+    return D;
+}
+
+/* Deletes K, with hash h, from the slots of T, ignoring any table being
+ * migrated into it.  Returns as table_delete.
+ */
+data_t delete_entry(table_t *T, hashkey_t key, unsigned int h)
 {
     T->num_probes_for_most_recent_call = 1;	//changed to 1 from 0
-    int addr = hash(key) % T->table_size;
+    int addr = h % T->table_size;
     int prob_dec;
     int M = T->table_size;
     int first_addr = addr;
     data_t *returnData;
     sep_chain_t *prev = NULL;;
 
+    if (T->probing_type == SWISS || T->probing_type == ROBIN) {
+        T->num_probes_for_most_recent_call = 0;
+        if (T->probing_type == SWISS) {
+            addr = swiss_find(T, key, h);
+        } else {
+            addr = robin_find(T, key, h);
+        }
+        if (addr < 0) {
+            return NULL;
+        }
+        returnData = T->oa[addr].data_ptr;
+        free(T->oa[addr].key);
+        remove_slot(T, addr);
+        return returnData;
+    }
     if (T->probing_type == CHAIN) {
-    	//no chain/list
-    	if (T->sc[addr] == NULL)
-    		return NULL;
     	sep_chain_t *current = T->sc[addr];
-    	//if only one node
-    	if (current->next == NULL) {
-			returnData = current->data_ptr;
-			free(current->key);
-			free(current);
-			T->sc[addr] = NULL;
-			T->num_stored_keys--;
-			return returnData;
-		}
-    	while (current->next != NULL) {
-    		if (equal_key(current->key, key) == 1) {
-    			//if at beginning of chain
-    			if (prev == NULL && current->next != NULL) {
-    				returnData = current->data_ptr;
+    	while (current != NULL) {
+    		if (match_key(T, current->key, current->hash, key, h)) {
+    			returnData = current->data_ptr;
+    			if (prev == NULL) {		//at beginning of chain
     				T->sc[addr] = current->next;
-    				free(current->key);
-					free(current);
-					T->num_stored_keys--;
-					return returnData;
-				}
-				//if in middle of chain
-				else if (prev != NULL && current->next != NULL) {
-					returnData = current->data_ptr;
-					prev->next = current->next;
-					free(current->key);
-					free(current);
-					T->num_stored_keys--;
-					return returnData;
-				}
-				//if at end of list
-				else if (prev != NULL && current->next == NULL) {
-					returnData = current->data_ptr;
-					prev->next = NULL;
-					free(current->key);
-					free(current);
-					T->num_stored_keys--;
-					return returnData;
-				}
-			}
-			prev = current;
-			current = current->next;
-		}
+    			} else {
+    				prev->next = current->next;
+    			}
+    			free(current->key);
+    			free_chain(T, current);
+    			T->num_stored_keys--;
+    			return returnData;
+    		}
+    		T->num_probes_for_most_recent_call++;
+    		prev = current;
+    		current = current->next;
+    	}
     }
     else {
         // TODO set prob_dec based on type
@@ -323,11 +538,14 @@ data_t table_delete (table_t *T, hashkey_t key)
 		do {
 			//key found, delete key
 			T->num_probes_for_most_recent_call++;
-			if (equal_key(T->oa[addr].key, key)) {
-				T->oa[addr].deleted = 1;
+			if (T->oa[addr].key == EmptyKey && T->oa[addr].deleted != DeleteKey) {
+				break;		//never used: the key is not further on
+			}
+			if (T->oa[addr].key != EmptyKey
+			        && match_key(T, T->oa[addr].key, T->oa[addr].hash, key, h)) {
 				returnData = T->oa[addr].data_ptr;
 				free(T->oa[addr].key);
-				T->num_stored_keys--;		//update num_stored
+				remove_slot(T, addr);	//marks it deleted, key cleared
 				return returnData;
 			}
 			addr = (addr + prob_dec) % M;
@@ -342,15 +560,42 @@ data_t table_delete (table_t *T, hashkey_t key)
  * found.
  */
 data_t table_retrieve (table_t *T, hashkey_t key) 
+{
+    unsigned int h = table_hash(T->hash_function, key);
+    data_t *D = locate_entry(T, key, h);
+    int probes;
+
+    if (D == NULL && T->old != NULL) {
+        probes = T->num_probes_for_most_recent_call;
+        D = locate_entry(T->old, key, h);
+        T->num_probes_for_most_recent_call = probes + T->old->num_probes_for_most_recent_call;
+    }
+    return D != NULL ? *D : NULL;
+}
+
+/* Looks for K, with hash h, in the slots of T, ignoring any table being
+ * migrated into it.
+ *
+ * RETURNS where the I of K is stored, or NULL if K is not found
+ */
+data_t *locate_entry(table_t *T, hashkey_t key, unsigned int h)
 {
     /* TODO: */
     int addr, prob_dec;
     T->num_probes_for_most_recent_call = 0;
-    addr = hash(key) % T->table_size;
+    addr = h % T->table_size;
     int M = T->table_size;
     int first_addr = addr;
     data_t *returnData;
 
+    if (T->probing_type == SWISS) {
+        addr = swiss_find(T, key, h);
+        return addr >= 0 ? &T->oa[addr].data_ptr : NULL;
+    }
+    if (T->probing_type == ROBIN) {
+        addr = robin_find(T, key, h);
+        return addr >= 0 ? &T->oa[addr].data_ptr : NULL;
+    }
     if (T->probing_type == CHAIN) {
 	    //no chain
 	    T->num_probes_for_most_recent_call++;
@@ -359,14 +604,14 @@ data_t table_retrieve (table_t *T, hashkey_t key)
     	}
     	sep_chain_t *current = T->sc[addr];
     	
-        while (equal_key(current->key, key) != 1) {
+        while (!match_key(T, current->key, current->hash, key, h)) {
         	T->num_probes_for_most_recent_call++;
         	if (current->next == NULL) {
         		return NULL;
         	}
         	current = current->next;
         }
-        returnData = current->data_ptr;	      
+        returnData = &current->data_ptr;	      
     	return returnData;
     }
     else {
@@ -380,11 +625,14 @@ data_t table_retrieve (table_t *T, hashkey_t key)
         // TODO look to find correct entry
 		do {
 			T->num_probes_for_most_recent_call++;
+			if (T->oa[addr].key == EmptyKey && T->oa[addr].deleted != DeleteKey) {
+				break;		//never used: the key is not further on
+			}
 			if (T->oa[addr].key != NULL) {
 				T->num_probes_for_most_recent_call++;
-				if (equal_key(T->oa[addr].key, key)) {
+				if (match_key(T, T->oa[addr].key, T->oa[addr].hash, key, h)) {
 					//T->num_probes_for_most_recent_call++;
-					returnData = T->oa[addr].data_ptr;
+					returnData = &T->oa[addr].data_ptr;
 					return returnData;
 				}
 			}
@@ -402,6 +650,9 @@ void table_destruct (table_t *T)
 {
     /*TODO free all the memory*/
     int i;
+    if (T->old != NULL) {
+        table_destruct(T->old);
+    }
     if (T->probing_type != CHAIN) {
     	for (i = 0; i < T->table_size; i++) {
     		if (T->oa[i].deleted != DeleteKey && T->oa[i].key != EmptyKey) {
@@ -410,6 +661,7 @@ void table_destruct (table_t *T)
     		free(T->oa[i].key);
     	}
     	free(T->oa);
+    	free(T->tags);
     }
     else if (T->probing_type == CHAIN) {
     	sep_chain_t *temp;
@@ -421,12 +673,12 @@ void table_destruct (table_t *T)
 					temp = current->next;
 					//free(current->data_ptr);
 					free(current->key);
-					free(current);
+					free_chain(T, current);
 					current = temp;
 				}
 				free(current->key);				
+				free_chain(T, current);
 			}
-			free(current);
 		}
 		free(T->sc);
 	}
@@ -448,7 +700,13 @@ int table_stats (table_t *T)
 void table_debug_print(table_t *T) {
     int i;
     int count = 0; 
-    printf("keys in table %d\n", T->num_stored_keys);
+    printf("keys in table %d\n", table_entries(T));
+    if (T->old != NULL) {
+        printf("old slots, migrated up to %d:\n", T->migrate_pos);
+        table_debug_print(T->old);
+        count = T->old->num_stored_keys;
+        printf("new slots:\n");
+    }
     if (T->probing_type == CHAIN) {
         sep_chain_t *rover;
         for (i = 0; i < T->table_size; i++)
@@ -479,7 +737,7 @@ void table_debug_print(table_t *T) {
         }
     }
     //printf("count is = %d; num_stored is %d\n", count, T->num_stored_keys);
-    assert(count == T->num_stored_keys);
+    assert(count == table_entries(T));
 }
 
 /* This function is for testing purposes only.  Given an index position into
@@ -520,6 +778,382 @@ hashkey_t table_peek(table_t *T, int index, int position)
 }
 
 
+/* Allocates a separate chaining node for T from its slab, or with malloc
+ * if the table was not given a slab.
+ */
+sep_chain_t *alloc_chain(table_t *T)
+{
+    if (T->node_slab != NULL)
+        return (sep_chain_t *)Mem_slab_alloc(T->node_slab);
+    return (sep_chain_t *)malloc(sizeof(sep_chain_t));
+}
+
+/* Returns a separate chaining node to wherever alloc_chain got it from. */
+void free_chain(table_t *T, sep_chain_t *node)
+{
+    if (T->node_slab != NULL)
+        Mem_slab_free(T->node_slab, node);
+    else
+        free(node);
+}
+
+/* RETURNS the SWISS tag of a key with hash h.  The bits are mixed first
+ * because hash() leaves the high bits of short keys zero.
+ */
+unsigned int tag_of(unsigned int h)
+{
+    return (h * 0x9E3779B1u) >> 25;
+}
+
+/* Sets the tag of slot, and its copies past the end of the tag array that
+ * let a group wrap around to the start of the table.
+ */
+void set_tag(table_t *T, int slot, unsigned char tag)
+{
+    int i;
+
+    T->tags[slot] = tag;
+    for (i = slot; i < GroupWidth; i += T->table_size)
+        T->tags[T->table_size + i] = tag;
+}
+
+/* RETURNS a mask with bit i set if group[i] == tag, for the 16 tags of a
+ * group
+ */
+unsigned int group_match(unsigned char *group, unsigned char tag)
+{
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)tag)));
+#else
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < GroupWidth; i++)
+        if (group[i] == tag)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/* RETURNS a mask with bit i set if group[i] holds no key */
+unsigned int group_free(unsigned char *group)
+{
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < GroupWidth; i++)
+        if (group[i] & TagEmpty)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/* Looks for key, with hash h, in a SWISS table.  Groups are scanned from
+ * slot h % table_size onwards; a key is only compared when its slot has
+ * the key's tag, and the search ends at the first group with an empty
+ * slot, as insert fills the first free slot in this order.
+ *
+ * RETURNS the slot of key, or -1 if it is not in the table
+ */
+int swiss_find(table_t *T, hashkey_t key, unsigned int h)
+{
+    int M = T->table_size, pos = h % M, g, slot;
+    unsigned int mask, tag = tag_of(h);
+
+    for (g = 0; g <= M / GroupWidth; g++) {
+        T->num_probes_for_most_recent_call++;
+        for (mask = group_match(T->tags + pos, tag); mask != 0; mask &= mask - 1) {
+            slot = (pos + __builtin_ctz(mask)) % M;
+            T->num_probes_for_most_recent_call++;
+            if (match_key(T, T->oa[slot].key, T->oa[slot].hash, key, h))
+                return slot;
+        }
+        if (group_match(T->tags + pos, TagEmpty) != 0)
+            return -1;
+        pos = (pos + GroupWidth) % M;
+    }
+    return -1;
+}
+
+/* RETURNS the first empty or deleted slot of a SWISS table in the probe
+ * order of hash h.  The table must not be full.
+ */
+int swiss_free_slot(table_t *T, unsigned int h)
+{
+    int M = T->table_size, pos = h % M;
+    unsigned int mask;
+
+    while ((mask = group_free(T->tags + pos)) == 0)
+        pos = (pos + GroupWidth) % M;
+    return (pos + __builtin_ctz(mask)) % M;
+}
+
+/* Looks for key, with hash h, in a ROBIN table.  Keys are kept in order
+ * of their home slots along a run, so the search can stop at the first
+ * key that is nearer its home than key would be.
+ *
+ * RETURNS the slot of key, or -1 if it is not in the table
+ */
+int robin_find(table_t *T, hashkey_t key, unsigned int h)
+{
+    int M = T->table_size, addr = h % M, dist;
+
+    for (dist = 0; dist < M; dist++) {
+        T->num_probes_for_most_recent_call++;
+        if (T->oa[addr].key == EmptyKey || T->oa[addr].probe_len < dist)
+            return -1;
+        if (T->oa[addr].probe_len == dist
+                && match_key(T, T->oa[addr].key, T->oa[addr].hash, key, h))
+            return addr;
+        addr = (addr + 1) % M;
+    }
+    return -1;
+}
+
+/* Inserts (key, D), with hash h, into a ROBIN table.  Walking from the
+ * home slot, the entry being placed swaps with any entry nearer its own
+ * home, and the displaced entry carries on until an empty slot takes it.
+ *
+ * RETURNS 0, 1 or -1 as table_insert
+ */
+int robin_insert(table_t *T, hashkey_t key, data_t D, unsigned int h)
+{
+    int M = T->table_size, addr;
+    table_entry_t carry, temp;
+
+    T->num_probes_for_most_recent_call = 0;
+    addr = robin_find(T, key, h);
+    if (addr >= 0) {
+        T->oa[addr].data_ptr = D;
+        return 1;
+    }
+    if (table_full(T)) {
+        return -1;
+    }
+    carry.key = key;
+    carry.data_ptr = D;
+    carry.deleted = 0;
+    carry.probe_len = 0;
+    carry.hash = h;
+    addr = h % M;
+    while (T->oa[addr].key != EmptyKey) {
+        T->num_probes_for_most_recent_call++;
+        if (T->oa[addr].probe_len < carry.probe_len) {
+            temp = T->oa[addr];
+            T->oa[addr] = carry;
+            carry = temp;
+        }
+        carry.probe_len++;
+        addr = (addr + 1) % M;
+    }
+    T->oa[addr] = carry;
+    T->num_stored_keys++;
+    return 0;
+}
+
+/* Empties slot addr of an open addressing table without freeing its key.
+ * ROBIN shifts the keys after it back a slot, up to an empty slot or a key
+ * already in its home slot; the other types mark the slot deleted.
+ */
+void remove_slot(table_t *T, int addr)
+{
+    int M = T->table_size, next;
+
+    if (T->probing_type == ROBIN) {
+        for (next = (addr + 1) % M;
+                T->oa[next].key != EmptyKey && T->oa[next].probe_len > 0;
+                next = (next + 1) % M) {
+            T->oa[addr] = T->oa[next];
+            T->oa[addr].probe_len--;
+            addr = next;
+        }
+        T->oa[addr].probe_len = 0;
+    } else {
+        T->oa[addr].deleted = DeleteKey;
+        T->num_deleted++;
+        if (T->probing_type == SWISS) {
+            set_tag(T, addr, TagDeleted);
+        }
+    }
+    T->oa[addr].key = EmptyKey;
+    T->oa[addr].data_ptr = NULL;
+    T->num_stored_keys--;
+}
+
+/* Turns on automatic resizing, see table.h */
+void table_auto_resize(table_t *T, double max_load, double min_load,
+        double max_deleted)
+{
+    assert(max_load >= 0 && min_load >= 0 && max_deleted >= 0);
+    assert(max_load == 0 || min_load < max_load / 2);
+    assert(max_load < 1 || T->probing_type == CHAIN);
+    T->max_load = max_load;
+    T->min_load = min_load;
+    T->max_deleted = max_deleted;
+}
+
+/* RETURNS the smallest prime that is at least n */
+int next_prime(int n)
+{
+    int d;
+
+    for (n = n < 2 ? 2 : n; ; n++) {
+        for (d = 2; d * d <= n && n % d != 0; d++)
+            ;
+        if (d * d > n)
+            return n;
+    }
+}
+
+/* Gives T new, empty slots of new_table_size and keeps its current slots
+ * as T->old, to be moved into the new ones by resize_step.  Every insert
+ * until the move is done may add a key, so each step moves enough slots
+ * to finish before the new slots pass max_load; a ROBIN slot can take a
+ * visit per key.  T is left as it was if memory runs out.
+ */
+void start_resize(table_t *T, int new_table_size)
+{
+    table_t *old = (table_t *)malloc(sizeof(table_t));
+    table_t *fresh = table_construct_hash(new_table_size, T->probing_type,
+            T->hash_function, T->node_slab);
+    double work, headroom;
+
+    if (old == NULL || fresh == NULL) {
+        free(old);
+        if (fresh != NULL) {
+            table_destruct(fresh);
+        }
+        return;
+    }
+    *old = *T;
+    old->max_load = old->min_load = old->max_deleted = 0;
+    old->num_key_compares = 0;
+    fresh->num_key_compares = T->num_key_compares;
+    table_auto_resize(fresh, T->max_load, T->min_load, T->max_deleted);
+    *T = *fresh;
+    free(fresh);
+    T->old = old;
+    T->migrate_pos = 0;
+
+    work = old->table_size;
+    if (old->probing_type == ROBIN) {
+        work += old->num_stored_keys;
+    }
+    headroom = T->max_load * T->table_size - old->num_stored_keys;
+    if (headroom < 1) {
+        headroom = 1;
+    }
+    if (work / headroom >= MigrateSlots) {
+        T->migrate_slots = (int) (work / headroom) + 1;
+    }
+}
+
+/* Moves the keys in slot of old into T.  A ROBIN slot gives up only one
+ * key, since the backward shift can refill it from the rest of its run;
+ * resize_step comes back to the slot until it stays empty.
+ */
+void migrate_slot(table_t *T, table_t *old, int slot)
+{
+    sep_chain_t *node, *next;
+
+    if (old->probing_type == CHAIN) {
+        for (node = old->sc[slot]; node != NULL; node = next) {
+            next = node->next;
+            insert_entry(T, node->key, node->data_ptr, node->hash);
+            free_chain(old, node);
+            old->num_stored_keys--;
+        }
+        old->sc[slot] = NULL;
+        return;
+    }
+    if (old->oa[slot].key != EmptyKey) {
+        insert_entry(T, old->oa[slot].key, old->oa[slot].data_ptr,
+                old->oa[slot].hash);
+        remove_slot(old, slot);
+    }
+}
+
+/* Does the auto-resize work of one insert or delete on T: migrates up to
+ * T->migrate_slots slots of the old table, one key at most from a ROBIN
+ * slot, if a resize is under way, or else starts a resize when T has
+ * passed one of its thresholds.  Thresholds are not checked during a
+ * migration, so the new size must hold the keys at no more than half of
+ * max_load: the other half is the room for the inserts made while they
+ * move.  A rebuild that needs more room grows, and a shrink that would
+ * not leave it is skipped.
+ */
+void resize_step(table_t *T)
+{
+    table_t *old = T->old;
+    int i, new_table_size = 0;
+
+    if (old != NULL) {
+        for (i = 0; i < T->migrate_slots && old->num_stored_keys > 0; i++) {
+            migrate_slot(T, old, T->migrate_pos);
+            if (old->probing_type != ROBIN || old->oa[T->migrate_pos].key == EmptyKey) {
+                T->migrate_pos = (T->migrate_pos + 1) % old->table_size;
+            }
+        }
+        if (old->num_stored_keys == 0) {
+            T->num_key_compares += old->num_key_compares;
+            // no keys are left to free, so skip table_destruct's walk
+            if (old->probing_type == CHAIN) {
+                free(old->sc);
+            } else {
+                free(old->oa);
+                free(old->tags);
+            }
+            free(old);
+            T->old = NULL;
+        }
+        return;
+    }
+    if (T->max_load == 0) {
+        return;
+    }
+    if (T->num_stored_keys > T->max_load * T->table_size) {
+        new_table_size = 2 * T->table_size;
+    } else if (T->num_stored_keys < T->min_load * T->table_size
+            && T->table_size / 2 >= MinTableSize
+            && T->num_stored_keys <= T->max_load * (T->table_size / 2) / 2) {
+        new_table_size = T->table_size / 2;
+    } else if (T->max_deleted > 0 && T->num_deleted > T->max_deleted * T->table_size) {
+        new_table_size = T->table_size;
+    }
+    if (new_table_size == 0) {
+        return;
+    }
+    if (T->num_stored_keys > T->max_load * new_table_size / 2) {
+        new_table_size = (int) (2 * T->num_stored_keys / T->max_load) + 1;
+    }
+    start_resize(T, next_prime(new_table_size));
+}
+
+/* RETURNS 1 if key, with hash h, is the stored key k, whose hash is kh.
+ * The hashes are compared first, so the string of k is only read, and
+ * counted in num_key_compares, when the keys are almost sure to match.
+ */
+int match_key(table_t *T, hashkey_t k, unsigned int kh, hashkey_t key,
+        unsigned int h)
+{
+    if (!SameHash(kh, h)) {
+        return 0;
+    }
+    T->num_key_compares++;
+    return equal_key(k, key);
+}
+
+/* returns the number of key strings compared, see table.h */
+long table_key_compares(table_t *T)
+{
+    if (T->old != NULL) {
+        return T->num_key_compares + T->old->num_key_compares;
+    }
+    return T->num_key_compares;
+}
+
 int equal_key(char *k1, char *k2)
 {
     return (strcmp(k1, k2) == 0);
@@ -1,8 +1,22 @@
 /* Donald Elmore
  */
 
-/* constants used to indicate type of probing.  */
-enum ProbeDec_t {LINEAR, DOUBLE, CHAIN};
+/* constants used to indicate type of probing.  SWISS is open addressing
+ * that keeps a one-byte tag per slot, made from the hash, in a separate
+ * array and scans the tags 16 slots at a time, so keys are only compared
+ * when their tags match.  ROBIN is linear probing with Robin Hood
+ * insertion: a key that is further from its home slot takes the place of
+ * one that is nearer to its own, which keeps probe lengths even.  Deleting
+ * shifts the following keys back instead of leaving a deleted mark.
+ */
+enum ProbeDec_t {LINEAR, DOUBLE, CHAIN, SWISS, ROBIN};
+
+/* constants used to indicate the hash function.  HASH33 is the classic
+ * h = 33 * h ^ c, one byte at a time.  FASTHASH reads the key 8 bytes at a
+ * time and mixes each word with a 128-bit multiply (after wyhash), which
+ * is faster on all but the shortest keys and spreads similar keys better.
+ */
+enum HashDec_t {HASH33, FASTHASH};
 
 typedef void *data_t;   /* pointer to the information, I, to be stored in the table */
 typedef char *hashkey_t;   /* the key, K, for the pair (K, I) */
@@ -10,6 +24,7 @@ typedef char *hashkey_t;   /* the key, K, for the pair (K, I) */
 typedef struct sep_chain_tag {
     hashkey_t key;
     data_t data_ptr;
+    unsigned int hash;      // of key, kept so the table never hashes it again
     struct sep_chain_tag *next;
 } sep_chain_t;
 
@@ -17,16 +32,29 @@ typedef struct table_etag {
     hashkey_t key;
     data_t data_ptr;
     int deleted;
+    int probe_len;          // ROBIN: slots from the key's home slot
+    unsigned int hash;      // of key, kept so the table never hashes it again
 } table_entry_t;
 
 typedef struct table_tag {
     // you need to fill in details, and you can change the names!
     int table_size;
     int probing_type;
+    int hash_function;      // HASH33 or FASTHASH
     int num_stored_keys;
     int num_probes_for_most_recent_call;
     table_entry_t *oa;
     sep_chain_t **sc;
+    struct mem_slab_tag *node_slab;   // CHAIN nodes come from here, or malloc if NULL
+    unsigned char *tags;    // SWISS: tag of each slot, then the first 16 again
+    int num_deleted;        // slots marked deleted
+    long num_key_compares;  // key strings compared, see table_key_compares
+    double max_load;        // auto-resize thresholds, see table_auto_resize
+    double min_load;
+    double max_deleted;
+    struct table_tag *old;  // slots still being moved into this table, or NULL
+    int migrate_pos;        // next slot of old to move
+    int migrate_slots;      // slots of old moved per insert or delete
 } table_t;
 
 /*  The empty table is created.  The table must be dynamically allocated and
@@ -35,7 +63,7 @@ typedef struct table_tag {
  *  the table is filled with a special empty key distinct from all other 
  *  nonempty keys (e.g., NULL).  
  *
- *  the probing_type must be one of {LINEAR, DOUBLE, CHAIN}
+ *  the probing_type must be one of {LINEAR, DOUBLE, CHAIN, SWISS, ROBIN}
  *
  *  Do not "correct" the table_size or probe decrement if there is a chance
  *  that the combinaion of table size or probe decrement will not cover
@@ -45,6 +73,23 @@ typedef struct table_tag {
  */
 table_t *table_construct(int table_size, int probing_type);  
 
+/* Same as table_construct, but for CHAIN the sep_chain_t nodes are
+ * allocated from slab (see mem.h), which must hand out slots of at least
+ * sizeof(sep_chain_t) bytes.  The slab may be shared by several tables and
+ * is not destroyed with the table.  A NULL slab means malloc.
+ */
+table_t *table_construct_slab(int table_size, int probing_type,
+        struct mem_slab_tag *slab);
+
+/* Same as table_construct_slab, but keys are hashed by hash_function, one
+ * of {HASH33, FASTHASH}.  The other constructors use HASH33.
+ */
+table_t *table_construct_hash(int table_size, int probing_type,
+        int hash_function, struct mem_slab_tag *slab);
+
+/* returns the hash of K by hash_function, one of {HASH33, FASTHASH} */
+unsigned int table_hash(int hash_function, hashkey_t K);
+
 /* Sequentially remove each table entry (K, I) and insert into a new
  * empty table with size new_table_size.  Free the memory for the old table
  * and return the pointer to the new table.  The probe type should remain
@@ -53,10 +98,31 @@ table_t *table_construct(int table_size, int probing_type);
  * Do not rehash the table during an insert or delete function call.  Instead
  * use drivers to verify under what conditions rehashing is required, and
  * call the rehash function in the driver to show how the performance
- * can be improved.
+ * can be improved.  The exception is a table given table_auto_resize.
  */
 table_t *table_rehash(table_t * T, int new_table_size);  
 
+/* Lets T resize itself.  When an insert or delete finds more than
+ * max_load * table_size keys in T, T starts growing to about twice its
+ * size; below min_load * table_size keys it starts shrinking to about half
+ * (but no smaller than 11), and with more than max_deleted * table_size
+ * slots marked deleted it starts rebuilding at the same size.  The keys
+ * may fill no more than half of max_load of the new slots, which leaves
+ * room for the inserts made while they move: a rebuild without that room
+ * grows instead, and a shrink waits until half the size has it.  Keys move
+ * to the new slots with each later insert and delete, and lookups search
+ * both sets of slots meanwhile.  Each call moves enough slots to finish
+ * before the new slots could pass max_load, 8 or about 4 / max_load if
+ * that is more, so no single call copies the whole table.  T keeps its
+ * address.
+ *
+ * min_load must be below max_load / 2, and max_load below 1 unless T is
+ * CHAIN.  A max_load of 0 turns resizing off and a max_deleted of 0 never
+ * rebuilds for deleted slots.
+ */
+void table_auto_resize(table_t *T, double max_load, double min_load,
+        double max_deleted);
+
 /* returns number of entries in the table */
 int table_entries(table_t *);
 
@@ -65,7 +131,9 @@ int table_entries(table_t *);
  */
 int table_full(table_t *);
 
-/* returns the number of table entries marked as deleted */
+/* returns the number of table entries marked as deleted, which is always
+ * 0 for ROBIN
+ */
 int table_deletekeys(table_t *);
    
 /* Insert a new table entry (K, I) into the table provided the table is not
@@ -103,10 +171,18 @@ data_t table_retrieve(table_t *, hashkey_t K);
 void table_destruct(table_t *);
 
 /* The number of probes for the most recent call to table_retrieve,
- * table_insert, or table_delete 
+ * table_insert, or table_delete.  For SWISS each group of 16 tags scanned
+ * and each key compared counts as a probe.
  */
 int table_stats(table_t *);  
 
+/* The number of times a key string has been compared with the key of a
+ * call since the table was constructed.  Each entry keeps the hash of its
+ * key, and the strings are only compared when the hashes are equal, so
+ * this is about one per successful call however many entries are probed.
+ */
+long table_key_compares(table_t *T);
+
 /* This function is for testing purposes only.  Given an index position into
  * the hash table return the value of the key if data is stored in this 
  * index position.  If the index position does not contain data, then the
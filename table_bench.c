@@ -0,0 +1,348 @@
+/* table_bench.c
+ * Purpose: measures the lookup throughput of the table ADT for every
+ *  probing type at load factors from 0.5 to 0.9.  Each table is filled
+ *  with distinct keys, then looked up with copies of those keys in random
+ *  order, so every lookup hits and compares strings as a caller's would.
+ *  Reports lookups per second, the mean probes per lookup (table_stats)
+ *  and the mean key strings compared per lookup (table_key_compares).
+ *  Then each open addressing type is held in equilibrium at load 0.8,
+ *  deleting a random key and inserting a new one over and over, and the
+ *  lookups are timed again as the churn goes on.  Last, a small table
+ *  grows to hold many keys, either rehashed by the driver whenever its
+ *  load passes 0.75 or by table_auto_resize, and the latency of every
+ *  insert is recorded.  It begins by timing the hash functions on their
+ *  own over a range of key lengths, and after the lookups it times CHAIN
+ *  with chains of 1 to 64 keys on average.  Building with
+ *  -DTABLE_NO_FINGERPRINT shows what the stored hashes save.
+ *
+ *  Build:  gcc -O2 -o table_bench table_bench.c table.c mem.c -lpthread -lm
+ *  Usage:  table_bench [-m table_size] [-n lookups] [-c churn] [-h hash]
+ *
+ *  -h fast makes the tables hash with FASTHASH instead of HASH33.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "table.h"
+
+#define GROWTH_KEYS     1000000
+#define GROWTH_START    1009        // slots the growing tables start with
+
+static int TableSize = 131071;
+static long NumLookups = 2000000;
+static long NumChurn = 800000;      // delete and insert pairs at the end
+static int HashFunction = HASH33;
+#define CHECKPOINTS 5               // NumChurn/8, /4, /2 and all of it
+
+// private function prototypes
+unsigned int bench_rand(unsigned int *state);
+double bench_seconds(struct timespec *from, struct timespec *to);
+char **bench_fill(table_t *T, int n);
+double bench_time_lookups(table_t *T, char **keys, int n, double *probes,
+        double *compares);
+void bench_lookups(int probing_type, double load, int table_size);
+void bench_equilibrium(int probing_type, double *rate, double *probes);
+int bench_compare_long(const void *a, const void *b);
+void bench_growth(int probing_type, int autoResize);
+void bench_hash(int len);
+
+/* bench_rand
+ * RETURNS the next number of a xorshift generator; state must not be 0
+ */
+unsigned int bench_rand(unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* RETURNS the seconds from from to to */
+double bench_seconds(struct timespec *from, struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* bench_fill
+ * inserts keys 0 to n-1 into T, each with T as its data
+ *
+ * RETURNS a copy of each key inserted, in random order
+ */
+char **bench_fill(table_t *T, int n)
+{
+    int i, j;
+    unsigned int seed = 2024;
+    char buf[32], **keys, *tmp;
+
+    keys = malloc(n * sizeof(char *));
+    for (i = 0; i < n; i++) {
+        sprintf(buf, "user:%08x", i * 2654435761u);
+        table_insert(T, strdup(buf), T);
+        keys[i] = strdup(buf);
+    }
+    for (i = n - 1; i > 0; i--) {
+        j = bench_rand(&seed) % (i + 1);
+        tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    return keys;
+}
+
+/* bench_time_lookups
+ * looks up NumLookups of the n keys in T, which must all be present, and
+ * sets probes and compares to the mean probes and key compares per lookup
+ *
+ * RETURNS millions of lookups per second
+ */
+double bench_time_lookups(table_t *T, char **keys, int n, double *probes,
+        double *compares)
+{
+    long l, total = 0, found = 0, compared = table_key_compares(T);
+    int i;
+    struct timespec start, stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0, i = 0; l < NumLookups; l++) {
+        found += (table_retrieve(T, keys[i]) == T);
+        total += table_stats(T);
+        if (++i == n)
+            i = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (found != NumLookups)
+        printf("lookups missed %ld keys!\n", NumLookups - found);
+    *probes = (double) total / NumLookups;
+    *compares = (double) (table_key_compares(T) - compared) / NumLookups;
+    return NumLookups / bench_seconds(&start, &stop) / 1e6;
+}
+
+/* bench_lookups
+ * fills a table of the given probing type and size to load and prints the
+ * rate of NumLookups successful lookups
+ */
+void bench_lookups(int probing_type, double load, int table_size)
+{
+    int n = load * table_size, i;
+    char **keys;
+    double rate, probes, compares;
+    table_t *T;
+
+    T = table_construct_hash(table_size, probing_type, HashFunction, NULL);
+    keys = bench_fill(T, n);
+    rate = bench_time_lookups(T, keys, n, &probes, &compares);
+    printf(" %8.2f %6.2f %5.2f", rate, probes, compares);
+    fflush(stdout);
+    for (i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+    table_destruct(T);
+}
+
+/* bench_equilibrium
+ * fills a table of the given probing type to load 0.8, then replaces a
+ * random key with a new one NumChurn times, timing lookups before the
+ * churn and at each checkpoint
+ */
+void bench_equilibrium(int probing_type, double *rate, double *probes)
+{
+    int n = 0.8 * TableSize, i, c = 0;
+    double compares;
+    unsigned int seed = 4711, next = n;
+    long churn;
+    char buf[32], **keys;
+    table_t *T;
+
+    T = table_construct_hash(TableSize, probing_type, HashFunction, NULL);
+    keys = bench_fill(T, n);
+    for (churn = 0; churn <= NumChurn; churn++) {
+        if (c < CHECKPOINTS && churn == (NumChurn >> (CHECKPOINTS - 1 - c)) * (c > 0)) {
+            rate[c] = bench_time_lookups(T, keys, n, &probes[c], &compares);
+            c++;
+        }
+        if (churn == NumChurn)
+            break;
+        i = bench_rand(&seed) % n;
+        if (table_delete(T, keys[i]) != T)
+            printf("delete missed a key!\n");
+        free(keys[i]);
+        sprintf(buf, "user:%08x", next++ * 2654435761u);
+        table_insert(T, strdup(buf), T);
+        keys[i] = strdup(buf);
+    }
+    for (i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+    table_destruct(T);
+}
+
+int bench_compare_long(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* bench_growth
+ * inserts GROWTH_KEYS keys into a table of GROWTH_START slots, which the
+ * driver rehashes to twice its size when the load passes 0.75, or which
+ * resizes itself if autoResize, and prints the insert rate and the
+ * latency percentiles of single inserts
+ */
+void bench_growth(int probing_type, int autoResize)
+{
+    long *ns = malloc(GROWTH_KEYS * sizeof(long)), total = 0;
+    int i;
+    char buf[32];
+    table_t *T;
+    struct timespec start, stop;
+
+    T = table_construct_hash(GROWTH_START, probing_type, HashFunction, NULL);
+    if (autoResize)
+        table_auto_resize(T, 0.75, 0, 0.2);
+    for (i = 0; i < GROWTH_KEYS; i++) {
+        sprintf(buf, "user:%08x", i * 2654435761u);
+        char *key = strdup(buf);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        table_insert(T, key, T);
+        if (!autoResize && table_entries(T) > 0.75 * T->table_size)
+            T = table_rehash(T, 2 * T->table_size + 1);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        ns[i] = (stop.tv_sec - start.tv_sec) * 1000000000L + stop.tv_nsec - start.tv_nsec;
+        total += ns[i];
+    }
+    qsort(ns, GROWTH_KEYS, sizeof(long), bench_compare_long);
+    printf(" %9.2f %9ld %9ld %10ld\n", GROWTH_KEYS / (total / 1e9) / 1e6,
+            ns[GROWTH_KEYS * 99 / 100], ns[GROWTH_KEYS * 999 / 1000],
+            ns[GROWTH_KEYS - 1]);
+    free(ns);
+    table_destruct(T);
+}
+
+/* bench_hash
+ * prints the rate at which each hash function hashes keys of len bytes
+ */
+void bench_hash(int len)
+{
+    int functions[] = {HASH33, FASTHASH};
+    char keys[64][257];
+    unsigned int seed = 31337, sink = 0;
+    long i, n = 50000000 / (len + 8);
+    int f, k, c;
+    double seconds;
+    struct timespec start, stop;
+
+    for (k = 0; k < 64; k++) {
+        for (c = 0; c < len; c++)
+            keys[k][c] = 'a' + bench_rand(&seed) % 26;
+        keys[k][len] = '\0';
+    }
+    printf("%-6d", len);
+    for (f = 0; f < 2; f++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n; i++)
+            sink += table_hash(functions[f], keys[i & 63]);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        seconds = bench_seconds(&start, &stop);
+        printf(" %9.2f %6.2f", n / seconds / 1e6, n * len / seconds / 1e9);
+    }
+    printf("%s\n", sink == 1 ? " " : "");
+}
+
+int main(int argc, char **argv)
+{
+    int types[] = {LINEAR, DOUBLE, CHAIN, SWISS, ROBIN};
+    char *names[] = {"linear", "double", "chain", "swiss", "robin"};
+    double loads[] = {0.5, 0.6, 0.7, 0.8, 0.9};
+    int churnTypes[] = {LINEAR, SWISS, ROBIN};
+    char *churnNames[] = {"linear", "swiss", "robin"};
+    double rate[3][CHECKPOINTS], probes[3][CHECKPOINTS];
+    int t, l, c, opt;
+
+    int lengths[] = {4, 8, 13, 16, 32, 64, 256};
+    int chains[] = {1, 4, 16, 64};
+
+    while ((opt = getopt(argc, argv, "m:n:c:h:")) != -1) {
+        if (opt == 'm')
+            TableSize = atoi(optarg);
+        else if (opt == 'n')
+            NumLookups = atol(optarg);
+        else if (opt == 'c')
+            NumChurn = atol(optarg);
+        else if (opt == 'h' && strcmp(optarg, "fast") == 0)
+            HashFunction = FASTHASH;
+        else if (opt == 'h' && strcmp(optarg, "33") == 0)
+            HashFunction = HASH33;
+        else {
+            fprintf(stderr, "usage: %s [-m table_size] [-n lookups] [-c churn] [-h 33|fast]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (TableSize < 2 || NumLookups < 1 || NumChurn < 0) {
+        fprintf(stderr, "table_size must be at least 2, lookups at least 1\n");
+        exit(1);
+    }
+
+    printf("hash functions: Mhashes/s and GB/s\n");
+    printf("%-6s %16s %16s\n", "bytes", "hash33", "fasthash");
+    for (l = 0; l < (int) (sizeof(lengths) / sizeof(lengths[0])); l++)
+        bench_hash(lengths[l]);
+
+    printf("\nlookups of present keys, table size %d, %s: Mlookups/s, probes and\n"
+            "key compares per lookup\n", TableSize,
+            HashFunction == FASTHASH ? "fasthash" : "hash33");
+    printf("%-6s", "load");
+    for (t = 0; t < (int) (sizeof(types) / sizeof(types[0])); t++)
+        printf(" %21s", names[t]);
+    printf("\n");
+    for (l = 0; l < (int) (sizeof(loads) / sizeof(loads[0])); l++) {
+        printf("%-6.1f", loads[l]);
+        for (t = 0; t < (int) (sizeof(types) / sizeof(types[0])); t++)
+            bench_lookups(types[t], loads[l], TableSize);
+        printf("\n");
+    }
+
+    printf("\nchain with long chains, %d keys\n%-9s %21s\n", TableSize, "keys/slot",
+            "chain");
+    for (c = 0; c < (int) (sizeof(chains) / sizeof(chains[0])); c++) {
+        printf("%-9d", chains[c]);
+        bench_lookups(CHAIN, chains[c], TableSize / chains[c]);
+        printf("\n");
+    }
+
+    printf("\nequilibrium at load 0.8, after churn delete and insert pairs\n");
+    printf("%-8s", "churn");
+    for (t = 0; t < (int) (sizeof(churnTypes) / sizeof(churnTypes[0])); t++) {
+        printf(" %15s", churnNames[t]);
+        bench_equilibrium(churnTypes[t], rate[t], probes[t]);
+    }
+    printf("\n");
+    for (c = 0; c < CHECKPOINTS; c++) {
+        printf("%-8ld", (NumChurn >> (CHECKPOINTS - 1 - c)) * (c > 0));
+        for (t = 0; t < (int) (sizeof(churnTypes) / sizeof(churnTypes[0])); t++)
+            printf(" %8.2f %6.2f", rate[t][c], probes[t][c]);
+        printf("\n");
+    }
+
+    printf("\ngrowing from %d slots to %d keys at load 0.75: Minserts/s and insert ns\n",
+            GROWTH_START, GROWTH_KEYS);
+    printf("%-8s %-7s %9s %9s %9s %10s\n", "type", "resize", "rate", "p99", "p999", "max");
+    for (t = 0; t < (int) (sizeof(churnTypes) / sizeof(churnTypes[0])); t++) {
+        for (c = 0; c <= 1; c++) {
+            printf("%-8s %-7s", churnNames[t], c ? "auto" : "rehash");
+            fflush(stdout);
+            bench_growth(churnTypes[t], c);
+        }
+    }
+    return 0;
+}
+
+/* vi:set ts=8 sts=4 sw=4 et: */